@@ -19,10 +19,13 @@
 #include "aff_data.hxx"
 #include "utils.hxx"
 
+#include <cwchar>
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
 
+#include <unicode/uchar.h>
+
 /*
  * Aff_Data class and the method parse() should be structured in the following
  * way. The data members of the class should be data structures that are
@@ -75,7 +78,7 @@ namespace nuspell {
  * code. Thus, the client code directly calls the destructors of all the private
  * data members of our class Dictionary.
  */
-inline namespace v3 {
+inline namespace v4 {
 }
 
 using namespace std;
@@ -1080,8 +1083,19 @@ auto Aff_Data::parse_dic(istream& in) -> bool
 		return false;
 	getline(in, line);
 
+	auto unreported_bytes = size_t(0);
+	auto report_progress = [&]() {
+		load_counters->bytes_parsed += unreported_bytes;
+		load_counters->words_inserted = words.size();
+		unreported_bytes = 0;
+	};
 	while (getline(in, line)) {
 		line_number++;
+		if (load_counters) {
+			unreported_bytes += line.size() + 1;
+			if (line_number % 4096 == 0)
+				report_progress();
+		}
 		word.clear();
 		flags_str.clear();
 		flags.clear();
@@ -1128,32 +1142,1311 @@ auto Aff_Data::parse_dic(istream& in) -> bool
 		auto ok = enc_conv.to_wide(word, wide_word);
 		if (!ok)
 			continue;
-		erase_chars(wide_word, ignored_chars);
-		auto casing = classify_casing(wide_word);
-		auto inserted = words.emplace(wide_word, flags);
-		switch (casing) {
-		case Casing::ALL_CAPITAL:
-			if (flags.empty())
-				break;
-			[[fallthrough]];
-		case Casing::PASCAL:
-		case Casing::CAMEL: {
-			// This if is needed for the test allcaps2.dic.
-			// Maybe it can be solved better by not checking the
-			// forbiddenword_flag, but by keeping the hidden
-			// homonym last in the multimap among the same-key
-			// entries.
-			if (inserted->second.contains(forbiddenword_flag))
-				break;
-			auto title_word = to_title(wide_word, icu_locale);
-			flags += HIDDEN_HOMONYM_FLAG;
-			words.emplace(title_word, flags);
+		insert_word(wide_word, flags);
+	}
+	if (load_counters)
+		report_progress();
+	return in.eof(); // success if we reached eof
+}
+
+/**
+ * @brief Inserts a word with its flags into the word list.
+ *
+ * The ignored characters are erased from the word. A word with capitals
+ * after the first letter also gets a hidden homonym in title case.
+ *
+ * @param word the word, modified
+ * @param flags the flags of the word, modified
+ */
+auto Aff_Data::insert_word(std::wstring& word, std::u16string& flags) -> void
+{
+	erase_chars(word, ignored_chars);
+	auto casing = classify_casing(word);
+	auto inserted = words.emplace(word, flags);
+	index_word(inserted->first, inserted->second);
+	switch (casing) {
+	case Casing::ALL_CAPITAL:
+		if (flags.empty())
+			break;
+		[[fallthrough]];
+	case Casing::PASCAL:
+	case Casing::CAMEL: {
+		// This if is needed for the test allcaps2.dic.
+		// Maybe it can be solved better by not checking the
+		// forbiddenword_flag, but by keeping the hidden
+		// homonym last in the multimap among the same-key
+		// entries.
+		if (inserted->second.contains(forbiddenword_flag))
 			break;
+		auto title_word = to_title(word, icu_locale);
+		flags += HIDDEN_HOMONYM_FLAG;
+		auto homonym = words.emplace(title_word, flags);
+		index_word(homonym->first, homonym->second);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Adds a word that was inserted into the word list to the indexes.
+ *
+ * While the .dic file is parsed, no index is built yet, so this does
+ * nothing.
+ *
+ * @param word the inserted word
+ * @param flags flags of the inserted word
+ */
+auto Aff_Data::index_word(const std::wstring& word, const Flag_Set& flags)
+    -> void
+{
+	compound_part_index.add(word, flags);
+	word_prefix_index.add(word);
+	deletion_index.add(word, flags, prefixes, suffixes);
+	phonetic_index.add(phonetic_table, word, flags);
+	if (!word_form_dawg.empty())
+		word_form_dawg.mark_incomplete();
+}
+
+namespace {
+auto bigram_key(wchar_t a, wchar_t b) -> uint64_t
+{
+	return uint64_t(uint32_t(a)) << 32 | uint32_t(b);
+}
+
+auto sort_unique(std::vector<uint64_t>& v)
+{
+	std::sort(begin(v), end(v));
+	v.erase(std::unique(begin(v), end(v)), end(v));
+}
+
+/**
+ * @brief Merges the unsorted tail of a vector into its sorted unique head.
+ */
+auto merge_unique(std::vector<uint64_t>& v, size_t sorted_size)
+{
+	auto mid = begin(v) + sorted_size;
+	std::sort(mid, end(v));
+	std::inplace_merge(begin(v), mid, end(v));
+	v.erase(std::unique(begin(v), end(v)), end(v));
+}
+} // namespace
+
+/**
+ * @brief Builds the index from the words that can be compounded.
+ *
+ * A root can be compounded if it has some of the flags in compound_flags or
+ * if some affix can give such flag to it. Every part in a compound is a root
+ * with at most one prefix and one suffix, so its beginning comes either from
+ * the prefix appending or from the root with the prefix stripping removed,
+ * and similarly for its end. Parts shorter than two characters are kept as
+ * single character wildcards.
+ *
+ * @param words dictionary words
+ * @param prefixes prefix table
+ * @param suffixes suffix table
+ * @param compound_flags flags that allow a root to be part of a compound
+ */
+auto Compound_Part_Index::build(const Word_List& words,
+                                const Prefix_Table& prefixes,
+                                const Suffix_Table& suffixes,
+                                const Flag_Set& compound_flags) -> void
+{
+	using namespace std;
+	*this = Compound_Part_Index();
+	built = true;
+	if (compound_flags.empty())
+		return;
+	this->compound_flags = compound_flags;
+
+	for (auto f : compound_flags)
+		all_roots |= prefixes.has_continuation_flag(f) ||
+		             suffixes.has_continuation_flag(f);
+
+	size_t max_prefix_growth = 0, max_suffix_growth = 0;
+	prefix_strips = {L""};
+	suffix_strips = {L""};
+	for (auto& p : prefixes) {
+		auto& a = p.appending;
+		max_prefix_strip = max(max_prefix_strip, p.stripping.size());
+		if (a.size() > p.stripping.size())
+			max_prefix_growth = max(max_prefix_growth,
+			                        a.size() - p.stripping.size());
+		prefix_strips.push_back(p.stripping);
+		auto last_two = a.size() - min(a.size(), size_t(2));
+		prefix_variants.emplace_back(p.stripping, a.substr(last_two));
+		if (a.size() >= 2)
+			begin_bigrams.push_back(bigram_key(a[0], a[1]));
+		else if (a.size() == 1)
+			begin_wildcards.insert(a[0]);
+	}
+	for (auto& s : suffixes) {
+		auto& a = s.appending;
+		max_suffix_strip = max(max_suffix_strip, s.stripping.size());
+		if (a.size() > s.stripping.size())
+			max_suffix_growth = max(max_suffix_growth,
+			                        a.size() - s.stripping.size());
+		suffix_strips.push_back(s.stripping);
+		suffix_variants.emplace_back(s.stripping, a.substr(0, 2));
+		auto n = a.size();
+		if (n >= 2)
+			end_bigrams.push_back(bigram_key(a[n - 2], a[n - 1]));
+		else if (n == 1)
+			end_wildcards.insert(a[0]);
+	}
+	max_growth = max_prefix_growth + max_suffix_growth;
+	for (auto v : {&prefix_strips, &suffix_strips}) {
+		sort(begin(*v), end(*v));
+		v->erase(unique(begin(*v), end(*v)), end(*v));
+	}
+	for (auto v : {&prefix_variants, &suffix_variants}) {
+		sort(begin(*v), end(*v));
+		v->erase(unique(begin(*v), end(*v)), end(*v));
+	}
+
+	max_length = max_growth;
+	for (size_t i = 0; i != words.bucket_count(); ++i) {
+		for (auto& [root, flags] : words.bucket_data(i)) {
+			if (all_roots || can_compound(flags))
+				add_root_parts(root);
+		}
+	}
+	sort_unique(begin_bigrams);
+	sort_unique(end_bigrams);
+}
+
+auto Compound_Part_Index::can_compound(const Flag_Set& flags) const -> bool
+{
+	return std::any_of(begin(compound_flags), end(compound_flags),
+	                   [&](auto f) { return flags.contains(f); });
+}
+
+/**
+ * @brief Appends the beginnings and ends of the parts that a root gives,
+ * without sorting them.
+ */
+auto Compound_Part_Index::add_root_parts(std::wstring_view r) -> void
+{
+	using namespace std;
+	auto add_begin = [&](wstring_view w) {
+		if (w.size() >= 2)
+			begin_bigrams.push_back(bigram_key(w[0], w[1]));
+		else if (w.size() == 1)
+			begin_wildcards.insert(w[0]);
+	};
+	auto add_end = [&](wstring_view w) {
+		auto n = w.size();
+		if (n >= 2)
+			end_bigrams.push_back(bigram_key(w[n - 2], w[n - 1]));
+		else if (n == 1)
+			end_wildcards.insert(w[0]);
+	};
+
+	max_length = max(max_length, r.size() + max_growth);
+	for (auto& ps : prefix_strips) {
+		if (!begins_with(r, ps))
+			continue;
+		auto core = r.substr(ps.size());
+		if (core.size() >= max_suffix_strip + 2) {
+			add_begin(core);
+			continue;
+		}
+		if (core.size() == max_suffix_strip + 1) {
+			add_begin(core.substr(0, 1));
+			continue;
+		}
+		add_begin(core);
+		auto w = wstring();
+		for (auto& [ss, sa] : suffix_variants) {
+			if (!ends_with(core, ss))
+				continue;
+			w = core.substr(0, core.size() - ss.size());
+			w += sa;
+			add_begin(w);
+		}
+	}
+	for (auto& ss : suffix_strips) {
+		if (!ends_with(r, ss))
+			continue;
+		auto core = r.substr(0, r.size() - ss.size());
+		if (core.size() >= max_prefix_strip + 2) {
+			add_end(core);
+			continue;
+		}
+		if (core.size() == max_prefix_strip + 1) {
+			add_end(core.substr(core.size() - 1));
+			continue;
+		}
+		add_end(core);
+		auto w = wstring();
+		for (auto& [ps, pa] : prefix_variants) {
+			if (!begins_with(core, ps))
+				continue;
+			w = pa;
+			w += core.substr(ps.size());
+			add_end(w);
 		}
-		default:
+	}
+}
+
+/**
+ * @brief Adds a root that was inserted into the word list after building.
+ *
+ * Does nothing if the index is not built.
+ *
+ * @param root the new root
+ * @param flags flags of the root
+ */
+auto Compound_Part_Index::add(const std::wstring& root, const Flag_Set& flags)
+    -> void
+{
+	if (compound_flags.empty() || (!all_roots && !can_compound(flags)))
+		return;
+	auto n_begin = begin_bigrams.size();
+	auto n_end = end_bigrams.size();
+	add_root_parts(root);
+	merge_unique(begin_bigrams, n_begin);
+	merge_unique(end_bigrams, n_end);
+}
+
+/**
+ * @brief Checks if a word part could be found in a compound word.
+ *
+ * @param part word part
+ * @return false if the part surely can not be found, true otherwise
+ */
+auto Compound_Part_Index::may_be_part(std::wstring_view part) const -> bool
+{
+	using namespace std;
+	if (!built)
+		return true;
+	if (part.size() > max_length)
+		return false;
+	if (part.size() < 2)
+		return true;
+	auto n = part.size();
+	if (!begin_wildcards.contains(part[0]) &&
+	    !binary_search(begin(begin_bigrams), end(begin_bigrams),
+	                   bigram_key(part[0], part[1])))
+		return false;
+	if (!end_wildcards.contains(part[n - 1]) &&
+	    !binary_search(begin(end_bigrams), end(end_bigrams),
+	                   bigram_key(part[n - 2], part[n - 1])))
+		return false;
+	return true;
+}
+
+/**
+ * @brief Builds the index from the dictionary words and affixes.
+ *
+ * @param words dictionary words
+ * @param prefixes prefix table
+ * @param suffixes suffix table
+ * @param complex_prefixes true if two prefixes can be applied
+ * @param compounding true if the dictionary has compounding, in that case
+ * the index accepts everything
+ */
+auto Word_Prefix_Index::build(const Word_List& words,
+                              const Prefix_Table& prefixes,
+                              const Suffix_Table& suffixes,
+                              bool complex_prefixes, bool compounding) -> void
+{
+	using namespace std;
+	*this = Word_Prefix_Index();
+	if (compounding)
+		return;
+	active = true;
+	two_prefixes = complex_prefixes || prefixes.has_continuation_flags();
+	two_suffixes = suffixes.has_continuation_flags();
+	roots.reserve(words.size());
+	for (size_t i = 0; i != words.bucket_count(); ++i)
+		for (auto& word_entry : words.bucket_data(i))
+			roots.push_back(word_entry.first);
+	for (auto& p : prefixes)
+		prefix_pairs.emplace_back(p.appending, p.stripping);
+	for (auto& x : suffixes)
+		suffix_appendings.push_back(x.appending);
+	for (auto v : {&roots, &suffix_appendings}) {
+		sort(begin(*v), end(*v));
+		v->erase(unique(begin(*v), end(*v)), end(*v));
+	}
+	for (auto& a : suffix_appendings)
+		max_suffix_tail = max(max_suffix_tail, a.size());
+	// With two suffixes, the inner appending can be followed by the outer.
+	if (two_suffixes)
+		max_suffix_tail *= 2;
+	sort(begin(prefix_pairs), end(prefix_pairs));
+	prefix_pairs.erase(unique(begin(prefix_pairs), end(prefix_pairs)),
+	                   end(prefix_pairs));
+}
+
+/**
+ * @brief Adds a root that was inserted into the word list after building.
+ *
+ * Does nothing if the index is not built.
+ */
+auto Word_Prefix_Index::add(const std::wstring& root) -> void
+{
+	if (!active)
+		return;
+	auto it = std::lower_bound(begin(roots), end(roots), root);
+	if (it == end(roots) || *it != root)
+		roots.insert(it, root);
+}
+
+/**
+ * @brief Gets the length of the longest beginning of s that begins a root.
+ */
+auto Word_Prefix_Index::root_prefix_length(std::wstring_view s) const
+    -> size_t
+{
+	// The root that shares the longest beginning with s is next to the
+	// place where s would be inserted.
+	auto common_length = [&](std::wstring_view r) {
+		auto m = mismatch(begin(s), end(s), begin(r), end(r));
+		return size_t(m.first - begin(s));
+	};
+	auto it = lower_bound(begin(roots), end(roots), s);
+	auto ret = size_t(0);
+	if (it != end(roots))
+		ret = common_length(*it);
+	if (it != begin(roots))
+		ret = std::max(ret, common_length(*prev(it)));
+	return ret;
+}
+
+/**
+ * @brief Gets the first position in s where the appended part of suffixes
+ * can start, so that the rest of s is not longer than they are.
+ */
+auto Word_Prefix_Index::first_suffix_start(std::wstring_view s) const
+    -> size_t
+{
+	return s.size() - std::min(s.size(), max_suffix_tail);
+}
+
+auto Word_Prefix_Index::is_suffix_prefix(std::wstring_view s) const -> bool
+{
+	auto& sa = suffix_appendings;
+	auto it = lower_bound(begin(sa), end(sa), s);
+	return it != end(sa) && begins_with(*it, s);
+}
+
+/**
+ * @brief Checks if s can be the beginning of what suffixes append.
+ */
+auto Word_Prefix_Index::may_be_suffix_part(std::wstring_view s) const -> bool
+{
+	if (is_suffix_prefix(s))
+		return true;
+	if (!two_suffixes)
+		return false;
+	// The outer suffix may strip a part of the inner one, so the inner
+	// appending is only a prefix too.
+	for (size_t m = 1; m < s.size(); ++m) {
+		if (!is_suffix_prefix(s.substr(0, m)))
 			break;
+		if (is_suffix_prefix(s.substr(m)))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Checks if s can be the beginning of a root with suffixes.
+ */
+auto Word_Prefix_Index::may_be_unprefixed(std::wstring_view s) const -> bool
+{
+	// The roots can be cut by the suffix stripping at any point before
+	// the longest beginning of s that is a beginning of a root.
+	auto lo = root_prefix_length(s);
+	if (lo == s.size())
+		return true;
+	for (auto k = first_suffix_start(s); k <= lo; ++k)
+		if (may_be_suffix_part(s.substr(k)))
+			return true;
+	return false;
+}
+
+auto Word_Prefix_Index::may_be_prefixed(std::wstring_view s,
+                                        bool allow_second) const -> bool
+{
+	auto rest = std::wstring();
+	for (auto& [appending, stripping] : prefix_pairs) {
+		if (begins_with(appending, s))
+			return true;
+		if (!begins_with(s, appending))
+			continue;
+		rest = stripping;
+		rest += s.substr(appending.size());
+		if (may_be_unprefixed(rest))
+			return true;
+		if (allow_second && may_be_prefixed(rest, false))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Checks if a string can be the beginning of a word.
+ *
+ * @param s string to check
+ * @return false if no word begins with s, true otherwise
+ */
+auto Word_Prefix_Index::may_be_prefix(std::wstring_view s) const -> bool
+{
+	if (!active || s.empty())
+		return true;
+	return may_be_unprefixed(s) || may_be_prefixed(s, two_prefixes);
+}
+
+/**
+ * @brief Gets a bound on the length of the beginnings of s that begin words.
+ *
+ * Uses a binary search, so it is cheaper than calling may_be_prefix() for
+ * each beginning of s.
+ *
+ * @param s string to check
+ * @return length n such that no word begins with the first n + 1 or more
+ * characters of s, s.size() if there is none
+ */
+auto Word_Prefix_Index::max_prefix_length(std::wstring_view s) const
+    -> size_t
+{
+	if (!active)
+		return s.size();
+	// The result is correct even when the index is not monotonic, as all
+	// strings longer than a rejected one are rejected too.
+	size_t lo = 0, hi = s.size();
+	while (lo < hi) {
+		auto mid = lo + (hi - lo + 1) / 2;
+		if (may_be_prefix(s.substr(0, mid)))
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/**
+ * @brief Appends the characters that follow s in the sorted strings that
+ * begin with s.
+ */
+auto static add_next_chars(const std::vector<std::wstring>& sorted,
+                           std::wstring_view s, std::wstring& out) -> void
+{
+	auto it = lower_bound(begin(sorted), end(sorted), s);
+	auto key = std::wstring(s);
+	for (; it != end(sorted) && begins_with(*it, s);) {
+		if (it->size() == s.size()) {
+			++it;
+			continue;
 		}
+		auto c = (*it)[s.size()];
+		out += c;
+		if (c == WCHAR_MAX)
+			break;
+		// skip to the first string with the next character
+		key.resize(s.size());
+		key += c + 1;
+		it = lower_bound(it, end(sorted), key);
 	}
-	return in.eof(); // success if we reached eof
+}
+
+auto Word_Prefix_Index::add_next_suffix_part_chars(std::wstring_view s,
+                                                   std::wstring& out) const
+    -> void
+{
+	add_next_chars(suffix_appendings, s, out);
+	if (!two_suffixes)
+		return;
+	for (size_t m = 1; m <= s.size(); ++m) {
+		if (!is_suffix_prefix(s.substr(0, m)))
+			break;
+		add_next_chars(suffix_appendings, s.substr(m), out);
+	}
+}
+
+auto Word_Prefix_Index::add_next_unprefixed_chars(std::wstring_view s,
+                                                  std::wstring& out) const
+    -> void
+{
+	auto lo = root_prefix_length(s);
+	if (lo == s.size())
+		add_next_chars(roots, s, out);
+	for (auto k = first_suffix_start(s); k <= lo; ++k)
+		add_next_suffix_part_chars(s.substr(k), out);
+}
+
+auto Word_Prefix_Index::add_next_prefixed_chars(std::wstring_view s,
+                                                bool allow_second,
+                                                std::wstring& out) const
+    -> void
+{
+	auto rest = std::wstring();
+	for (auto& [appending, stripping] : prefix_pairs) {
+		if (appending.size() > s.size() && begins_with(appending, s))
+			out += appending[s.size()];
+		if (!begins_with(s, appending))
+			continue;
+		rest = stripping;
+		rest += s.substr(appending.size());
+		add_next_unprefixed_chars(rest, out);
+		if (allow_second)
+			add_next_prefixed_chars(rest, false, out);
+	}
+}
+
+/**
+ * @brief Gets the characters that can follow a beginning of a word.
+ *
+ * It is the counterpart of may_be_prefix(), for each character c that is
+ * not in the result may_be_prefix() rejects s + c. Like a list of the
+ * children of a node in a trie, but it may contain extra characters.
+ *
+ * @param s beginning of a word
+ * @param out sorted characters that can follow s
+ * @return false if the index is not active and any character can follow s,
+ * out is not set in that case
+ */
+auto Word_Prefix_Index::next_chars(std::wstring_view s,
+                                   std::wstring& out) const -> bool
+{
+	if (!active)
+		return false;
+	out.clear();
+	add_next_unprefixed_chars(s, out);
+	add_next_prefixed_chars(s, two_prefixes, out);
+	sort(begin(out), end(out));
+	out.erase(unique(begin(out), end(out)), end(out));
+	return true;
+}
+
+auto static deletion_hash(std::wstring_view s) -> uint32_t
+{
+	auto h = std::hash<std::wstring_view>()(s);
+	return uint32_t(h ^ (uint64_t(h) >> 32));
+}
+
+/**
+ * @brief Appends the hashes of s and of all strings left after deleting up
+ * to dist characters of s at positions not before start.
+ */
+auto static add_deletion_hashes(std::wstring& s, size_t start, size_t dist,
+                                std::vector<uint32_t>& out) -> void
+{
+	out.push_back(deletion_hash(s));
+	if (dist == 0)
+		return;
+	for (size_t i = start; i < s.size(); ++i) {
+		auto c = s[i];
+		s.erase(i, 1);
+		add_deletion_hashes(s, i, dist - 1, out);
+		s.insert(i, 1, c);
+	}
+}
+
+namespace {
+/**
+ * @brief Gives the forms of roots with one affix, and with a suffix and a
+ * prefix that cross.
+ *
+ * The conditions are not checked for the cross products, so it can give more
+ * forms than there are correct words.
+ */
+class Affixed_Forms {
+	using Prefix_Ptrs = std::vector<const Prefix<wchar_t>*>;
+	using Suffix_Ptrs = std::vector<const Suffix<wchar_t>*>;
+	std::unordered_map<char16_t, Prefix_Ptrs> prefixes_by_flag;
+	std::unordered_map<char16_t, Suffix_Ptrs> suffixes_by_flag;
+
+	auto add_prefixed(const std::wstring& w, const Flag_Set& flags,
+	                  bool cross_only, std::vector<std::wstring>& out) const
+	    -> void;
+
+      public:
+	Affixed_Forms(const Prefix_Table& prefixes,
+	              const Suffix_Table& suffixes)
+	{
+		for (auto& p : prefixes)
+			prefixes_by_flag[p.flag].push_back(&p);
+		for (auto& x : suffixes)
+			suffixes_by_flag[x.flag].push_back(&x);
+	}
+	auto add(const std::wstring& root, const Flag_Set& flags,
+	         std::vector<std::wstring>& out) const -> void;
+};
+
+auto Affixed_Forms::add_prefixed(const std::wstring& w, const Flag_Set& flags,
+                                 bool cross_only,
+                                 std::vector<std::wstring>& out) const -> void
+{
+	for (auto f : flags) {
+		auto it = prefixes_by_flag.find(f);
+		if (it == end(prefixes_by_flag))
+			continue;
+		for (auto p : it->second) {
+			if (cross_only && !p->cross_product)
+				continue;
+			if (!begins_with(w, p->stripping))
+				continue;
+			if (!cross_only && !p->check_condition(w))
+				continue;
+			out.push_back(p->to_derived_copy(w));
+		}
+	}
+}
+
+/**
+ * @brief Appends the root and its affixed forms.
+ */
+auto Affixed_Forms::add(const std::wstring& root, const Flag_Set& flags,
+                        std::vector<std::wstring>& out) const -> void
+{
+	out.push_back(root);
+	add_prefixed(root, flags, false, out);
+	for (auto f : flags) {
+		auto it = suffixes_by_flag.find(f);
+		if (it == end(suffixes_by_flag))
+			continue;
+		for (auto x : it->second) {
+			if (!ends_with(root, x->stripping) ||
+			    !x->check_condition(root))
+				continue;
+			auto derived = x->to_derived_copy(root);
+			if (x->cross_product)
+				add_prefixed(derived, flags, true, out);
+			out.push_back(std::move(derived));
+		}
+	}
+}
+} // namespace
+
+/**
+ * @brief Builds the index.
+ *
+ * @param words dictionary words
+ * @param prefixes prefix table
+ * @param suffixes suffix table
+ * @param compounding true if the dictionary has compounding
+ * @param max_distance maximal number of deleted characters
+ * @param max_forms the index is not built if the roots give more forms
+ * @return statistics, including whether the index was built
+ */
+auto Deletion_Index::build(const Word_List& words,
+                           const Prefix_Table& prefixes,
+                           const Suffix_Table& suffixes, bool compounding,
+                           size_t max_distance, size_t max_forms)
+    -> Deletion_Index_Stats
+{
+	using namespace std;
+	auto start_time = chrono::steady_clock::now();
+	auto stats = Deletion_Index_Stats();
+	clear();
+	if (compounding || max_distance == 0 ||
+	    prefixes.has_continuation_flags() ||
+	    suffixes.has_continuation_flags())
+		return stats;
+
+	auto affixed_forms = Affixed_Forms(prefixes, suffixes);
+	for (size_t i = 0; i != words.bucket_count(); ++i) {
+		for (auto& [root, flags] : words.bucket_data(i)) {
+			affixed_forms.add(root, flags, forms);
+			if (forms.size() > max_forms) {
+				clear();
+				return stats;
+			}
+		}
+	}
+	sort(begin(forms), end(forms));
+	forms.erase(unique(begin(forms), end(forms)), end(forms));
+	forms.shrink_to_fit();
+
+	auto hashes = vector<uint32_t>();
+	auto form = wstring();
+	for (size_t i = 0; i != forms.size(); ++i) {
+		form = forms[i];
+		hashes.clear();
+		add_deletion_hashes(form, 0, max_distance, hashes);
+		sort(begin(hashes), end(hashes));
+		hashes.erase(unique(begin(hashes), end(hashes)), end(hashes));
+		for (auto h : hashes)
+			entries.emplace_back(h, uint32_t(i));
+	}
+	sort(begin(entries), end(entries));
+	entries.shrink_to_fit();
+	max_dist = max_distance;
+
+	stats.built = true;
+	stats.forms = forms.size();
+	stats.deletions = entries.size();
+	stats.memory = entries.capacity() * sizeof(entries[0]) +
+	               forms.capacity() * sizeof(forms[0]);
+	for (auto& f : forms)
+		stats.memory += (f.capacity() + 1) * sizeof(wchar_t);
+	stats.build_time = chrono::steady_clock::now() - start_time;
+	return stats;
+}
+
+/**
+ * @brief Adds a root that was inserted into the word list after building.
+ *
+ * Does nothing if the index is not built. The limit on the number of forms
+ * is not checked.
+ *
+ * @param root the new root
+ * @param flags flags of the root
+ * @param prefixes prefix table
+ * @param suffixes suffix table
+ */
+auto Deletion_Index::add(const std::wstring& root, const Flag_Set& flags,
+                         const Prefix_Table& prefixes,
+                         const Suffix_Table& suffixes) -> void
+{
+	using namespace std;
+	if (max_dist == 0)
+		return;
+	auto new_forms = vector<wstring>();
+	Affixed_Forms(prefixes, suffixes).add(root, flags, new_forms);
+	sort(begin(new_forms), end(new_forms));
+	new_forms.erase(unique(begin(new_forms), end(new_forms)),
+	                end(new_forms));
+	auto known = [&](auto& f) {
+		return binary_search(begin(forms), end(forms), f);
+	};
+	new_forms.erase(remove_if(begin(new_forms), end(new_forms), known),
+	                end(new_forms));
+	if (new_forms.empty())
+		return;
+
+	// merge the forms, the indexes of the old ones shift
+	auto merged = vector<wstring>();
+	merged.reserve(forms.size() + new_forms.size());
+	auto new_id = vector<uint32_t>(forms.size());
+	auto added_ids = vector<uint32_t>();
+	auto i = size_t(0);
+	auto j = size_t(0);
+	while (i != forms.size() || j != new_forms.size()) {
+		auto id = uint32_t(merged.size());
+		if (j == new_forms.size() ||
+		    (i != forms.size() && forms[i] < new_forms[j])) {
+			new_id[i] = id;
+			merged.push_back(move(forms[i++]));
+		}
+		else {
+			added_ids.push_back(id);
+			merged.push_back(move(new_forms[j++]));
+		}
+	}
+	forms = move(merged);
+	// the renumbering keeps the order, so the entries stay sorted
+	for (auto& e : entries)
+		e.second = new_id[e.second];
+
+	auto n_entries = entries.size();
+	auto hashes = vector<uint32_t>();
+	auto form = wstring();
+	for (auto id : added_ids) {
+		form = forms[id];
+		hashes.clear();
+		add_deletion_hashes(form, 0, max_dist, hashes);
+		sort(begin(hashes), end(hashes));
+		hashes.erase(unique(begin(hashes), end(hashes)), end(hashes));
+		for (auto h : hashes)
+			entries.emplace_back(h, id);
+	}
+	auto mid = begin(entries) + n_entries;
+	sort(mid, end(entries));
+	inplace_merge(begin(entries), mid, end(entries));
+}
+
+auto Deletion_Index::clear() -> void
+{
+	max_dist = 0;
+	forms = {};
+	entries = {};
+}
+
+/**
+ * @brief Gets the word forms that are near a word.
+ *
+ * Gets the forms that share a string with the word after deleting up to
+ * distance characters from each of them. These include all forms within
+ * distance edits of the word, and can include some others.
+ *
+ * @param word word to search around
+ * @param distance maximal number of deleted characters, should not be
+ * larger than max_distance()
+ * @param out sorted forms
+ */
+auto Deletion_Index::near_forms(std::wstring_view word, size_t distance,
+                                std::vector<std::wstring_view>& out) const
+    -> void
+{
+	using namespace std;
+	out.clear();
+	auto hashes = vector<uint32_t>();
+	auto w = wstring(word);
+	add_deletion_hashes(w, 0, distance, hashes);
+	sort(begin(hashes), end(hashes));
+	hashes.erase(unique(begin(hashes), end(hashes)), end(hashes));
+	auto ids = vector<uint32_t>();
+	for (auto h : hashes) {
+		auto it = lower_bound(begin(entries), end(entries),
+		                      pair<uint32_t, uint32_t>(h, 0));
+		for (; it != end(entries) && it->first == h; ++it)
+			ids.push_back(it->second);
+	}
+	sort(begin(ids), end(ids));
+	ids.erase(unique(begin(ids), end(ids)), end(ids));
+	for (auto i : ids)
+		out.push_back(forms[i]);
+}
+
+/**
+ * @brief Builds the automaton.
+ *
+ * Uses the incremental construction of a minimal automaton from sorted
+ * input. After a word is added, the states of the previous word past the
+ * common prefix are final and get replaced by equal registered ones.
+ *
+ * @param sorted_forms unique forms sorted by word
+ */
+auto Word_Form_Dawg::build(const std::vector<Form>& sorted_forms) -> void
+{
+	using namespace std;
+	clear();
+	if (sorted_forms.empty())
+		return;
+
+	auto flag_set_ids = unordered_map<u16string, uint32_t>();
+	auto get_flag_set_id = [&](const Flag_Set* f) -> uint32_t {
+		if (!f)
+			return 0;
+		auto id = uint32_t(flag_sets.size() + 1);
+		auto [it, inserted] = flag_set_ids.emplace(f->data(), id);
+		if (inserted)
+			flag_sets.push_back(*f);
+		return it->second;
+	};
+	auto value_ids = unordered_map<uint64_t, uint32_t>();
+	auto get_value = [&](const Form& f) {
+		auto a = get_flag_set_id(f.flags);
+		auto b = get_flag_set_id(f.flags_skip_hidden_homonym);
+		auto id = uint32_t(values.size() + 1);
+		auto key = uint64_t(a) << 32 | b;
+		auto [it, inserted] = value_ids.emplace(key, id);
+		if (inserted)
+			values.emplace_back(a, b);
+		return it->second;
+	};
+
+	struct Build_Node {
+		vector<pair<wchar_t, uint32_t>> edges;
+		uint32_t value = 0;
+	};
+	auto tmp = vector<Build_Node>(1);
+	auto registry = unordered_map<u32string, uint32_t>();
+	auto sig = u32string();
+	// path[i] is the state after i characters of the previous word
+	auto path = vector<uint32_t>{0};
+	auto minimize_down_to = [&](size_t len) {
+		for (auto i = path.size() - 1; i > len; --i) {
+			auto child = path[i];
+			auto& n = tmp[child];
+			sig.clear();
+			sig += char32_t(n.value);
+			for (auto& [c, target] : n.edges) {
+				sig += char32_t(c);
+				sig += char32_t(target);
+			}
+			auto [it, inserted] = registry.emplace(sig, child);
+			if (!inserted) {
+				tmp[path[i - 1]].edges.back().second =
+				    it->second;
+				n = Build_Node();
+			}
+			path.pop_back();
+		}
+	};
+	auto prev = wstring_view();
+	for (auto& f : sorted_forms) {
+		auto& w = f.word;
+		auto p = size_t(mismatch(begin(prev), end(prev), begin(w),
+		                         end(w))
+		                    .first -
+		                begin(prev));
+		minimize_down_to(p);
+		for (auto i = p; i != w.size(); ++i) {
+			auto id = uint32_t(tmp.size());
+			tmp.emplace_back();
+			tmp[path.back()].edges.emplace_back(w[i], id);
+			path.push_back(id);
+		}
+		tmp[path.back()].value = get_value(f);
+		prev = w;
+	}
+	minimize_down_to(0);
+
+	// renumber the reachable states in breadth first order
+	auto new_id = vector<uint32_t>(tmp.size(), UINT32_MAX);
+	auto order = vector<uint32_t>{0};
+	new_id[0] = 0;
+	for (size_t k = 0; k != order.size(); ++k) {
+		for (auto& e : tmp[order[k]].edges) {
+			if (new_id[e.second] != UINT32_MAX)
+				continue;
+			new_id[e.second] = uint32_t(order.size());
+			order.push_back(e.second);
+		}
+	}
+	nodes.resize(order.size());
+	for (size_t k = 0; k != order.size(); ++k) {
+		auto& n = tmp[order[k]];
+		nodes[k].first_edge = uint32_t(edge_labels.size());
+		for (auto& [c, target] : n.edges) {
+			edge_labels.push_back(c);
+			edge_targets.push_back(new_id[target]);
+		}
+		nodes[k].last_edge = uint32_t(edge_labels.size());
+		nodes[k].value = n.value;
+	}
+}
+
+auto Word_Form_Dawg::clear() -> void
+{
+	has_all_forms = true;
+	nodes = {};
+	edge_labels = {};
+	edge_targets = {};
+	flag_sets = {};
+	values = {};
+}
+
+/**
+ * @brief Gets the state after a transition, UINT32_MAX if there is none.
+ */
+auto Word_Form_Dawg::next_state(uint32_t state, wchar_t c) const -> uint32_t
+{
+	auto labels = begin(edge_labels);
+	auto first = labels + nodes[state].first_edge;
+	auto last = labels + nodes[state].last_edge;
+	auto it = lower_bound(first, last, c);
+	if (it == last || *it != c)
+		return UINT32_MAX;
+	return edge_targets[it - labels];
+}
+
+auto Word_Form_Dawg::state_flags(uint32_t state,
+                                 bool skip_hidden_homonym) const
+    -> const Flag_Set*
+{
+	auto v = nodes[state].value;
+	if (v == 0)
+		return nullptr;
+	auto& [a, b] = values[v - 1];
+	auto i = skip_hidden_homonym ? b : a;
+	return i ? &flag_sets[i - 1] : nullptr;
+}
+
+/**
+ * @brief Looks up a word form.
+ *
+ * @param word word to look up
+ * @param skip_hidden_homonym true to skip the hidden homonyms
+ * @return flags of the form or nullptr if it is not a correct form
+ */
+auto Word_Form_Dawg::lookup(std::wstring_view word,
+                            bool skip_hidden_homonym) const -> const Flag_Set*
+{
+	if (nodes.empty())
+		return nullptr;
+	auto n = uint32_t(0);
+	for (auto c : word) {
+		n = next_state(n, c);
+		if (n == UINT32_MAX)
+			return nullptr;
+	}
+	return state_flags(n, skip_hidden_homonym);
+}
+
+/**
+ * @brief Gets the lengths of the beginnings of a word that are correct
+ * forms.
+ *
+ * All of them are found with one walk of the automaton.
+ *
+ * @param word word whose beginnings are looked up, including whole word
+ * @param skip_hidden_homonym true to skip the hidden homonyms
+ * @param out ascending lengths of the beginnings
+ */
+auto Word_Form_Dawg::prefix_lengths(std::wstring_view word,
+                                    bool skip_hidden_homonym,
+                                    std::vector<size_t>& out) const -> void
+{
+	out.clear();
+	if (nodes.empty())
+		return;
+	auto n = uint32_t(0);
+	for (size_t i = 0; i != word.size(); ++i) {
+		n = next_state(n, word[i]);
+		if (n == UINT32_MAX)
+			return;
+		if (state_flags(n, skip_hidden_homonym))
+			out.push_back(i + 1);
+	}
+}
+
+auto Word_Form_Dawg::memory() const -> size_t
+{
+	auto ret = nodes.capacity() * sizeof(Node) +
+	           edge_labels.capacity() * sizeof(wchar_t) +
+	           edge_targets.capacity() * sizeof(uint32_t) +
+	           values.capacity() * sizeof(values[0]) +
+	           flag_sets.capacity() * sizeof(Flag_Set);
+	for (auto& f : flag_sets)
+		ret += f.data().capacity() * sizeof(char16_t);
+	return ret;
+}
+
+/**
+ * @brief Appends the sorted unique hashes of the trigrams of a phonetic code,
+ * with the start and the end of the code marked by a null character.
+ */
+auto static add_trigram_hashes(std::wstring_view code,
+                               std::vector<uint32_t>& out) -> void
+{
+	using namespace std;
+	auto marked = wstring(1, L'\0');
+	marked += code;
+	marked += L'\0';
+	auto first = out.size();
+	for (size_t i = 0; i + 3 <= marked.size(); ++i)
+		out.push_back(deletion_hash(wstring_view(marked).substr(i, 3)));
+	sort(begin(out) + first, end(out));
+	out.erase(unique(begin(out) + first, end(out)), end(out));
+}
+
+/**
+ * @brief Gives the phonetic code of a word.
+ *
+ * @param table PHONE rules
+ * @param word the word, in any casing
+ * @param out the code
+ */
+auto Phonetic_Index::code(const Phonetic_Table<wchar_t>& table,
+                          std::wstring_view word, std::wstring& out) -> void
+{
+	out.assign(word);
+	for (auto& c : out)
+		c = u_toupper(c);
+	table.code(out);
+}
+
+/**
+ * @brief Builds the index.
+ *
+ * @param words dictionary words
+ * @param table PHONE rules
+ * @param excluded_flags roots with any of these flags are not indexed
+ */
+auto Phonetic_Index::build(const Word_List& words,
+                           const Phonetic_Table<wchar_t>& table,
+                           const Flag_Set& excluded_flags) -> void
+{
+	using namespace std;
+	auto start_time = chrono::steady_clock::now();
+	clear();
+	excluded = excluded_flags;
+	auto c = wstring();
+	for (size_t i = 0; i != words.bucket_count(); ++i) {
+		for (auto& [root, flags] : words.bucket_data(i)) {
+			if (any_of(begin(excluded_flags), end(excluded_flags),
+			           [&](auto f) { return flags.contains(f); }))
+				continue;
+			code(table, root, c);
+			entries.emplace_back(c, root);
+		}
+	}
+	sort(begin(entries), end(entries));
+	entries.erase(unique(begin(entries), end(entries)), end(entries));
+	entries.shrink_to_fit();
+
+	auto hashes = vector<uint32_t>();
+	for (size_t i = 0; i != entries.size(); ++i) {
+		// equal codes are next to each other and share the hashes
+		if (i == 0 || entries[i].first != entries[i - 1].first) {
+			hashes.clear();
+			add_trigram_hashes(entries[i].first, hashes);
+		}
+		for (auto h : hashes)
+			trigrams.emplace_back(h, uint32_t(i));
+	}
+	sort(begin(trigrams), end(trigrams));
+	trigrams.shrink_to_fit();
+	build_time = chrono::steady_clock::now() - start_time;
+}
+
+/**
+ * @brief Adds a root that was inserted into the word list after building.
+ *
+ * Does nothing if the index is not built.
+ *
+ * @param table PHONE rules
+ * @param root the new root
+ * @param flags flags of the root
+ */
+auto Phonetic_Index::add(const Phonetic_Table<wchar_t>& table,
+                         const std::wstring& root, const Flag_Set& flags)
+    -> void
+{
+	using namespace std;
+	if (entries.empty() ||
+	    any_of(begin(excluded), end(excluded),
+	           [&](auto f) { return flags.contains(f); }))
+		return;
+	auto e = Entry();
+	code(table, root, e.first);
+	e.second = root;
+	auto it = lower_bound(begin(entries), end(entries), e);
+	if (it != end(entries) && *it == e)
+		return;
+	auto id = uint32_t(it - begin(entries));
+	entries.insert(it, move(e));
+	// the renumbering keeps the order, so the trigrams stay sorted
+	for (auto& t : trigrams)
+		if (t.second >= id)
+			++t.second;
+	auto hashes = vector<uint32_t>();
+	add_trigram_hashes(entries[id].first, hashes);
+	auto n_trigrams = trigrams.size();
+	for (auto h : hashes)
+		trigrams.emplace_back(h, id);
+	auto mid = begin(trigrams) + n_trigrams;
+	sort(mid, end(trigrams));
+	inplace_merge(begin(trigrams), mid, end(trigrams));
+}
+
+auto Phonetic_Index::clear() -> void
+{
+	entries = {};
+	trigrams = {};
+	excluded = {};
+	build_time = {};
+}
+
+/**
+ * @brief Gets the roots whose codes share a trigram with a code.
+ *
+ * @param code phonetic code of the misspelled word
+ * @param out entries ordered by code, without repetitions
+ */
+auto Phonetic_Index::similar(std::wstring_view code,
+                             std::vector<const Entry*>& out) const -> void
+{
+	using namespace std;
+	out.clear();
+	auto hashes = vector<uint32_t>();
+	add_trigram_hashes(code, hashes);
+	auto ids = vector<uint32_t>();
+	for (auto h : hashes) {
+		auto it = lower_bound(begin(trigrams), end(trigrams),
+		                      pair<uint32_t, uint32_t>(h, 0));
+		for (; it != end(trigrams) && it->first == h; ++it)
+			ids.push_back(it->second);
+	}
+	sort(begin(ids), end(ids));
+	ids.erase(unique(begin(ids), end(ids)), end(ids));
+	for (auto i : ids)
+		out.push_back(&entries[i]);
+}
+
+auto Phonetic_Index::stats() const -> Phonetic_Index_Stats
+{
+	auto ret = Phonetic_Index_Stats();
+	ret.built = !entries.empty();
+	ret.roots = entries.size();
+	ret.trigrams = trigrams.size();
+	ret.memory = entries.capacity() * sizeof(Entry) +
+	             trigrams.capacity() * sizeof(trigrams[0]);
+	for (auto& [c, root] : entries)
+		ret.memory += (c.capacity() + root.capacity() + 2) *
+		              sizeof(wchar_t);
+	ret.build_time = build_time;
+	return ret;
+}
+
+/**
+ * @brief Builds the lookup indexes that are derived from the loaded data.
+ *
+ * Should be called after parse_aff() and parse_dic(). If not called, the
+ * indexes accept everything, so they do not affect the results. Only the
+ * index used by spell checking is built, the ones that speed up suggestions
+ * are optional and built by their own functions.
+ */
+auto Aff_Data::build_indexes() -> void
+{
+	auto compound_flags = Flag_Set();
+	for (auto f : {compound_flag, compound_begin_flag, compound_middle_flag,
+	               compound_last_flag})
+		if (f)
+			compound_flags.insert(f);
+	compound_part_index.build(words, prefixes, suffixes, compound_flags);
+}
+
+/**
+ * @brief Builds the optional Word_Prefix_Index.
+ *
+ * @return true if the index was built, false for dictionaries with
+ * compounding, where it would accept everything
+ */
+auto Aff_Data::build_word_prefix_index() -> bool
+{
+	auto compounding = compound_flag || compound_begin_flag ||
+	                   compound_middle_flag || compound_last_flag ||
+	                   !compound_rules.empty();
+	word_prefix_index.build(words, prefixes, suffixes, complex_prefixes,
+	                        compounding);
+	return !word_prefix_index.empty();
+}
+
+/**
+ * @brief Builds the optional Deletion_Index.
+ *
+ * @param max_distance maximal number of deleted characters
+ * @param max_forms the index is not built if the roots give more forms
+ * @return statistics, including whether the index was built
+ */
+auto Aff_Data::build_deletion_index(size_t max_distance, size_t max_forms)
+    -> Deletion_Index_Stats
+{
+	auto compounding = compound_flag || compound_begin_flag ||
+	                   compound_middle_flag || compound_last_flag ||
+	                   !compound_rules.empty();
+	return deletion_index.build(words, prefixes, suffixes, compounding,
+	                            max_distance, max_forms);
+}
+
+/**
+ * @brief Builds the optional Phonetic_Index.
+ *
+ * It is built only if the dictionary has PHONE rules. Building it codes every
+ * root, which is much slower than loading the dictionary, so it pays off only
+ * when many words get suggestions.
+ *
+ * @return statistics, including whether the index was built
+ */
+auto Aff_Data::build_phonetic_index() -> Phonetic_Index_Stats
+{
+	auto not_suggested = Flag_Set();
+	for (auto f : {HIDDEN_HOMONYM_FLAG, forbiddenword_flag, nosuggest_flag,
+	               compound_onlyin_flag})
+		if (f)
+			not_suggested.insert(f);
+	phonetic_index.clear();
+	if (!phonetic_table.empty())
+		phonetic_index.build(words, phonetic_table, not_suggested);
+	return phonetic_index.stats();
 }
 } // namespace nuspell
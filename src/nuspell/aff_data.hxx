@@ -26,11 +26,14 @@
 
 #include "structures.hxx"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iosfwd>
 #include <unicode/locid.h>
 
 namespace nuspell {
-inline namespace v3 {
+inline namespace v4 {
 
 class Encoding {
 	std::string name;
@@ -102,6 +105,262 @@ struct Extractor_First_of_Word_Pair {
 using Word_List = Hash_Multiset<std::pair<std::wstring, Flag_Set>, std::wstring,
                                 Extractor_First_of_Word_Pair>;
 
+/**
+ * @brief Index of the word parts that can appear in a compound word.
+ *
+ * Holds the maximal length and the possible first two and last two characters
+ * of the words that can be part of a compound, including their affixed forms.
+ * The index is conservative. If a part fails the check, it can not be found
+ * in the dictionary with any affixes, otherwise it still needs to be looked
+ * up. An index that is not built accepts every part.
+ */
+class Compound_Part_Index {
+	bool built = false;
+	size_t max_length = 0;
+	std::vector<uint64_t> begin_bigrams;
+	std::vector<uint64_t> end_bigrams;
+	String_Set<wchar_t> begin_wildcards;
+	String_Set<wchar_t> end_wildcards;
+
+	// summary of the affixes, kept for adding roots later
+	Flag_Set compound_flags;
+	bool all_roots = false;
+	size_t max_prefix_strip = 0;
+	size_t max_suffix_strip = 0;
+	size_t max_growth = 0;
+	std::vector<std::wstring> prefix_strips;
+	std::vector<std::wstring> suffix_strips;
+	/** distinct pairs of stripping and last two chars of appending */
+	std::vector<std::pair<std::wstring, std::wstring>> prefix_variants;
+	/** distinct pairs of stripping and first two chars of appending */
+	std::vector<std::pair<std::wstring, std::wstring>> suffix_variants;
+
+	auto can_compound(const Flag_Set& flags) const -> bool;
+	auto add_root_parts(std::wstring_view root) -> void;
+
+      public:
+	auto build(const Word_List& words, const Prefix_Table& prefixes,
+	           const Suffix_Table& suffixes, const Flag_Set& compound_flags)
+	    -> void;
+	auto add(const std::wstring& root, const Flag_Set& flags) -> void;
+	auto may_be_part(std::wstring_view part) const -> bool;
+};
+
+/**
+ * @brief Index for checking if a string can be the beginning of a word.
+ *
+ * Accepts a string if it can be the beginning of some dictionary word with
+ * its affixes. It is conservative, it may accept strings that do not begin
+ * any word. Compound words are not indexed, so for dictionaries with
+ * compounding the index accepts everything, as does an index that is not
+ * built.
+ *
+ * The index is optional. It holds a copy of every root, so it takes about as
+ * much memory as the word list.
+ */
+class Word_Prefix_Index {
+	bool active = false;
+	bool two_prefixes = false;
+	bool two_suffixes = false;
+	std::vector<std::wstring> roots; /**< sorted */
+	/** pairs of appending and stripping */
+	std::vector<std::pair<std::wstring, std::wstring>> prefix_pairs;
+	std::vector<std::wstring> suffix_appendings; /**< sorted */
+	size_t max_suffix_tail = 0;
+
+	auto root_prefix_length(std::wstring_view s) const -> size_t;
+	auto first_suffix_start(std::wstring_view s) const -> size_t;
+	auto is_suffix_prefix(std::wstring_view s) const -> bool;
+	auto may_be_suffix_part(std::wstring_view s) const -> bool;
+	auto may_be_unprefixed(std::wstring_view s) const -> bool;
+	auto may_be_prefixed(std::wstring_view s, bool allow_second) const
+	    -> bool;
+	auto add_next_suffix_part_chars(std::wstring_view s,
+	                                std::wstring& out) const -> void;
+	auto add_next_unprefixed_chars(std::wstring_view s,
+	                               std::wstring& out) const -> void;
+	auto add_next_prefixed_chars(std::wstring_view s, bool allow_second,
+	                             std::wstring& out) const -> void;
+
+      public:
+	auto build(const Word_List& words, const Prefix_Table& prefixes,
+	           const Suffix_Table& suffixes, bool complex_prefixes,
+	           bool compounding) -> void;
+	auto add(const std::wstring& root) -> void;
+	auto empty() const { return !active; }
+	auto may_be_prefix(std::wstring_view s) const -> bool;
+	auto max_prefix_length(std::wstring_view s) const -> size_t;
+	auto next_chars(std::wstring_view s, std::wstring& out) const -> bool;
+};
+
+/**
+ * @brief Statistics about building of Deletion_Index.
+ */
+struct Deletion_Index_Stats {
+	bool built = false;
+	size_t forms = 0;     /**< number of word forms */
+	size_t deletions = 0; /**< number of indexed deletions */
+	size_t memory = 0;    /**< approximate memory used in bytes */
+	std::chrono::nanoseconds build_time = {};
+};
+
+/**
+ * @brief Symmetric delete index of the word forms.
+ *
+ * Holds all forms that the roots give with their affixes, and for each form
+ * the strings left after deleting up to max_distance() characters from it.
+ * Two words that are one insertion, deletion, substitution or adjacent
+ * transposition apart share a string with one character deleted, so the
+ * forms near a word are found with a few lookups instead of checking every
+ * edit of the word. Only hashes of the deletions are kept, so the result can
+ * contain extra forms.
+ *
+ * The index is optional. It is not built for dictionaries with compounding
+ * or continuation affixes, as not all correct words can be expanded there.
+ */
+class Deletion_Index {
+	size_t max_dist = 0;
+	std::vector<std::wstring> forms; /**< sorted */
+	/** sorted pairs of deletion hash and index of form */
+	std::vector<std::pair<uint32_t, uint32_t>> entries;
+
+      public:
+	auto build(const Word_List& words, const Prefix_Table& prefixes,
+	           const Suffix_Table& suffixes, bool compounding,
+	           size_t max_distance, size_t max_forms)
+	    -> Deletion_Index_Stats;
+	auto add(const std::wstring& root, const Flag_Set& flags,
+	         const Prefix_Table& prefixes, const Suffix_Table& suffixes)
+	    -> void;
+	auto clear() -> void;
+	auto max_distance() const { return max_dist; }
+	auto near_forms(std::wstring_view word, size_t distance,
+	                std::vector<std::wstring_view>& out) const -> void;
+};
+
+/**
+ * @brief Statistics about building of Word_Form_Dawg.
+ */
+struct Word_Form_Dawg_Stats {
+	bool built = false;
+	size_t candidates = 0; /**< number of generated candidate forms */
+	size_t forms = 0;      /**< number of correct forms */
+	size_t nodes = 0;
+	size_t edges = 0;
+	size_t memory = 0; /**< approximate memory used in bytes */
+	std::chrono::nanoseconds build_time = {};
+};
+
+/**
+ * @brief Minimal acyclic automaton of the correct simple word forms.
+ *
+ * Maps each word form that is correct without compounding to the flags that
+ * the affix stripping gives for it, with hidden homonyms accepted and
+ * skipped. Forms that end the same way and have the same flags share the
+ * states, so the automaton is much smaller than the list of forms.
+ *
+ * The automaton can not be extended. After roots are added to the word list,
+ * it is marked incomplete and the forms that it does not have must be looked
+ * up in the word list.
+ */
+class Word_Form_Dawg {
+	struct Node {
+		uint32_t first_edge = 0;
+		uint32_t last_edge = 0;
+		uint32_t value = 0; /**< 0 if not final, else index + 1 */
+	};
+	std::vector<Node> nodes;
+	std::vector<wchar_t> edge_labels;
+	std::vector<uint32_t> edge_targets;
+	std::vector<Flag_Set> flag_sets;
+	/** indexes + 1 in flag_sets, 0 if not correct */
+	std::vector<std::pair<uint32_t, uint32_t>> values;
+	bool has_all_forms = true;
+
+	auto next_state(uint32_t state, wchar_t c) const -> uint32_t;
+	auto state_flags(uint32_t state, bool skip_hidden_homonym) const
+	    -> const Flag_Set*;
+
+      public:
+	struct Form {
+		std::wstring word;
+		const Flag_Set* flags;
+		const Flag_Set* flags_skip_hidden_homonym;
+	};
+	auto build(const std::vector<Form>& sorted_forms) -> void;
+	auto clear() -> void;
+	auto empty() const { return nodes.empty(); }
+	auto complete() const { return has_all_forms; }
+	auto mark_incomplete() { has_all_forms = false; }
+	auto lookup(std::wstring_view word, bool skip_hidden_homonym) const
+	    -> const Flag_Set*;
+	auto prefix_lengths(std::wstring_view word, bool skip_hidden_homonym,
+	                    std::vector<size_t>& out) const -> void;
+	auto num_nodes() const { return nodes.size(); }
+	auto num_edges() const { return edge_labels.size(); }
+	auto memory() const -> size_t;
+};
+
+/**
+ * @brief Statistics about building of Phonetic_Index.
+ */
+struct Phonetic_Index_Stats {
+	bool built = false;
+	size_t roots = 0;    /**< number of indexed roots */
+	size_t trigrams = 0; /**< number of indexed trigrams of the codes */
+	size_t memory = 0;   /**< approximate memory used in bytes */
+	std::chrono::nanoseconds build_time = {};
+};
+
+/**
+ * @brief Index of the roots by their phonetic codes.
+ *
+ * The code of a word is what the PHONE rules give for the word in upper case.
+ * The trigrams of the codes are indexed too, with the start and the end of
+ * the code marked, so the roots that sound similar to a word are found with
+ * a few lookups instead of coding every root of the dictionary. Roots whose
+ * codes share only single characters or pairs with the word's code are not
+ * found, they are not similar enough to be suggested anyway.
+ *
+ * The index is optional. Without it the ngram suggestions do not include the
+ * sound-alike roots.
+ */
+class Phonetic_Index {
+      public:
+	/** pair of code and root */
+	using Entry = std::pair<std::wstring, std::wstring>;
+
+      private:
+	std::vector<Entry> entries; /**< sorted */
+	/** sorted pairs of trigram hash and index of entry */
+	std::vector<std::pair<uint32_t, uint32_t>> trigrams;
+	Flag_Set excluded;
+	std::chrono::nanoseconds build_time = {};
+
+      public:
+	auto static code(const Phonetic_Table<wchar_t>& table,
+	                 std::wstring_view word, std::wstring& out) -> void;
+	auto build(const Word_List& words, const Phonetic_Table<wchar_t>& table,
+	           const Flag_Set& excluded_flags) -> void;
+	auto add(const Phonetic_Table<wchar_t>& table, const std::wstring& root,
+	         const Flag_Set& flags) -> void;
+	auto clear() -> void;
+	auto empty() const { return entries.empty(); }
+	auto similar(std::wstring_view code,
+	             std::vector<const Entry*>& out) const -> void;
+	auto stats() const -> Phonetic_Index_Stats;
+};
+
+/**
+ * @brief Progress of parsing, updated while the .dic file is parsed.
+ *
+ * The counters can be read from other threads during the parsing.
+ */
+struct Load_Counters {
+	std::atomic<size_t> bytes_parsed{0};
+	std::atomic<size_t> words_inserted{0};
+};
+
 struct Aff_Data {
 	static constexpr auto HIDDEN_HOMONYM_FLAG = char16_t(-1);
 	static constexpr auto MAX_SUGGESTIONS = size_t(16);
@@ -169,23 +428,41 @@ struct Aff_Data {
 	unsigned short compound_syllable_max;
 	std::wstring compound_syllable_vowels;
 	std::vector<Compound_Pattern<wchar_t>> compound_patterns;
+	Compound_Part_Index compound_part_index;
+	Word_Prefix_Index word_prefix_index;
+	Deletion_Index deletion_index;
+	Word_Form_Dawg word_form_dawg;
+	Phonetic_Index phonetic_index;
 
 	// data members used only while parsing
 	Flag_Type flag_type;
 	Encoding encoding;
 	std::vector<Flag_Set> flag_aliases;
 	std::string wordchars; // deprecated?
+	Load_Counters* load_counters = nullptr;
 
 	auto parse_aff(std::istream& in) -> bool;
 	auto parse_dic(std::istream& in) -> bool;
+	auto insert_word(std::wstring& word, std::u16string& flags) -> void;
+	auto index_word(const std::wstring& word, const Flag_Set& flags)
+	    -> void;
+	auto build_indexes() -> void;
+	auto build_deletion_index(size_t max_distance = 1,
+	                          size_t max_forms = 5000000)
+	    -> Deletion_Index_Stats;
+	auto build_word_prefix_index() -> bool;
+	auto build_phonetic_index() -> Phonetic_Index_Stats;
+	auto phonetic_index_stats() const { return phonetic_index.stats(); }
 	auto parse_aff_dic(std::istream& aff, std::istream& dic)
 	{
-		if (parse_aff(aff))
-			return parse_dic(dic);
+		if (parse_aff(aff) && parse_dic(dic)) {
+			build_indexes();
+			return true;
+		}
 		return false;
 	}
 };
-} // namespace v3
+} // namespace v4
 } // namespace nuspell
 
 #endif // NUSPELL_AFF_DATA_HXX
@@ -19,9 +19,13 @@
 #include "dictionary.hxx"
 #include "utils.hxx"
 
+#include <condition_variable>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <unicode/uchar.h>
 
@@ -60,6 +64,55 @@ class At_Scope_Exit {
 
 #define AT_SCOPE_EXIT(...) ASE_INTERNAL2(__COUNTER__, __VA_ARGS__)
 
+/**
+ * @brief Returns the compounding counters of the calling thread.
+ *
+ * The counters accumulate over all compound checks done in the thread, they
+ * can be reset by assigning a default constructed value. They are meant for
+ * the benchmark and the tests, Dictionary does not expose them.
+ */
+auto Dict_Base::compounding_counters() -> Compounding_Counters&
+{
+	auto static thread_local counters = Compounding_Counters();
+	return counters;
+}
+
+/**
+ * @brief Returns the suggestion budget of the calling thread.
+ *
+ * It is set for the duration of one Dictionary::suggest() call, otherwise it
+ * is not limited.
+ */
+auto Dict_Base::suggest_budget() -> Suggest_Budget&
+{
+	auto static thread_local budget = Suggest_Budget();
+	return budget;
+}
+
+/**
+ * @brief Returns the hook of the calling thread that receives the raw
+ * suggestions each suggestion stage has added.
+ *
+ * It is installed by suggest_priv() when a suggestion sink is set. It points
+ * to a local of that call, so the sink may call Dictionary::suggest() again
+ * without destroying the hook that is running.
+ */
+auto Dict_Base::new_suggestions_hook() -> const New_Suggestions_Hook*&
+{
+	static thread_local const New_Suggestions_Hook* hook = nullptr;
+	return hook;
+}
+
+/**
+ * @brief Returns the sink of the calling thread that receives suggestions,
+ * already in their final form, while suggest_priv() is still running.
+ */
+auto Dict_Base::suggestion_sink() -> Suggestion_Sink&
+{
+	auto static thread_local sink = Suggestion_Sink();
+	return sink;
+}
+
 /**
  * @brief Check spelling for a word.
  *
@@ -347,6 +400,13 @@ auto Dict_Base::check_simple_word(std::wstring& s,
                                   Hidden_Homonym skip_hidden_homonym) const
     -> const Flag_Set*
 {
+	if (!word_form_dawg.empty()) {
+		// Added words are appended to their homonyms, so a form that
+		// the automaton has gets the same flags from the word list.
+		auto flags = word_form_dawg.lookup(s, skip_hidden_homonym);
+		if (flags || word_form_dawg.complete())
+			return flags;
+	}
 
 	for (auto& we : make_iterator_range(words.equal_range(s))) {
 		auto& word_flags = we.second;
@@ -415,6 +475,182 @@ auto Dict_Base::check_simple_word(std::wstring& s,
 	return nullptr;
 }
 
+/**
+ * @brief Adds a word of a personal dictionary to the word list.
+ *
+ * The word takes part in affixing, compounding and suggestions like the words
+ * of the .dic file. With a model word it gets the flags of the model, and
+ * thus the same affixes. The built indexes are updated, except the automaton
+ * of word forms, which is only marked incomplete.
+ *
+ * @param word the word to add, modified
+ * @param model dictionary word whose flags are copied, can be empty
+ * @return false if the model is not in the dictionary, the word is still
+ * added, without flags
+ */
+auto Dict_Base::add_personal_word(std::wstring& word, const std::wstring& model)
+    -> bool
+{
+	auto flags = u16string();
+	auto model_found = model.empty();
+	for (auto& we : make_iterator_range(words.equal_range(model))) {
+		if (we.second.contains(HIDDEN_HOMONYM_FLAG))
+			continue;
+		flags = we.second.data();
+		model_found = true;
+		break;
+	}
+	insert_word(word, flags);
+	return model_found;
+}
+
+/**
+ * @brief Adds many words of a personal dictionary to the word list.
+ *
+ * Instead of updating the indexes word by word, they are rebuilt once. The
+ * optional indexes are rebuilt only if they were built before, with the
+ * default limits.
+ *
+ * @param new_words pairs of word and model, the words are modified
+ */
+auto Dict_Base::add_personal_words(
+    std::vector<std::pair<std::wstring, std::wstring>>& new_words) -> void
+{
+	auto had_dawg = !word_form_dawg.empty();
+	auto deletion_distance = deletion_index.max_distance();
+	auto had_phonetic = !phonetic_index.empty();
+	auto had_prefix_index = !word_prefix_index.empty();
+	word_form_dawg.clear();
+	deletion_index.clear();
+	phonetic_index.clear();
+	word_prefix_index = {};
+	compound_part_index = {};
+	words.reserve(words.size() + new_words.size());
+	for (auto& [word, model] : new_words)
+		add_personal_word(word, model);
+	build_indexes();
+	if (had_prefix_index)
+		build_word_prefix_index();
+	if (deletion_distance != 0)
+		build_deletion_index(deletion_distance);
+	if (had_phonetic)
+		build_phonetic_index();
+	if (had_dawg)
+		build_word_form_dawg();
+}
+
+/**
+ * @brief Builds the optional automaton of the correct simple word forms.
+ *
+ * Every root is expanded with chains of up to three affixes, two of a kind
+ * at most, like the affix stripping does. The first affix of a kind can be
+ * allowed by the root flags, any affix by the continuation flags of the
+ * affixes applied before. Conditions are checked only for one affix on a
+ * root, so the chains give more forms than there are correct ones. Each
+ * generated form is then checked with check_simple_word(), and the correct
+ * ones are stored in the automaton with the flags it returned. From then on
+ * check_simple_word() only walks the automaton.
+ *
+ * @param max_forms the automaton is not built if more candidate forms are
+ * generated
+ * @return statistics, including whether the automaton was built
+ */
+auto Dict_Base::build_word_form_dawg(size_t max_forms) -> Word_Form_Dawg_Stats
+{
+	auto start_time = chrono::steady_clock::now();
+	auto stats = Word_Form_Dawg_Stats();
+	word_form_dawg.clear();
+
+	using Prefix_Ptrs = vector<const Prefix<wchar_t>*>;
+	using Suffix_Ptrs = vector<const Suffix<wchar_t>*>;
+	auto prefixes_by_flag = unordered_map<char16_t, Prefix_Ptrs>();
+	auto suffixes_by_flag = unordered_map<char16_t, Suffix_Ptrs>();
+	for (auto& p : prefixes)
+		prefixes_by_flag[p.flag].push_back(&p);
+	for (auto& x : suffixes)
+		suffixes_by_flag[x.flag].push_back(&x);
+	auto max_suffixes = complex_prefixes ? 1 : 2;
+	auto max_prefixes = complex_prefixes ? 2 : 1;
+
+	auto candidates = vector<wstring>();
+	// continuation flags of the applied affixes, by number of them
+	auto cont_flags = vector<Flag_Set>{Flag_Set()};
+	cont_flags.reserve(4);
+	auto apply = [&](auto& self, const wstring& w, const Flag_Set& flags,
+	                 int n_suffixes, int n_prefixes,
+	                 const auto& affix) -> void {
+		auto d = affix.to_derived_copy(w);
+		if (n_suffixes + n_prefixes != 0 || affix.check_condition(w))
+			candidates.push_back(d);
+		auto cont = cont_flags.back();
+		cont += affix.cont_flags;
+		cont_flags.push_back(move(cont));
+		self(self, d, flags, n_suffixes, n_prefixes);
+		cont_flags.pop_back();
+	};
+	// The second affix of a kind is allowed only by continuation flags.
+	auto expand = [&](auto& self, const wstring& w, const Flag_Set& flags,
+	                  int n_suffixes, int n_prefixes) -> void {
+		if (n_suffixes + n_prefixes == 3)
+			return;
+		auto& cont = cont_flags.back();
+		if (n_suffixes != max_suffixes) {
+			for (auto& [f, ptrs] : suffixes_by_flag) {
+				if (!cont.contains(f) &&
+				    (n_suffixes != 0 || !flags.contains(f)))
+					continue;
+				for (auto x : ptrs)
+					if (ends_with(w, x->stripping))
+						apply(self, w, flags,
+						      n_suffixes + 1,
+						      n_prefixes, *x);
+			}
+		}
+		if (n_prefixes != max_prefixes) {
+			for (auto& [f, ptrs] : prefixes_by_flag) {
+				if (!cont.contains(f) &&
+				    (n_prefixes != 0 || !flags.contains(f)))
+					continue;
+				for (auto p : ptrs)
+					if (begins_with(w, p->stripping))
+						apply(self, w, flags,
+						      n_suffixes,
+						      n_prefixes + 1, *p);
+			}
+		}
+	};
+	for (size_t i = 0; i != words.bucket_count(); ++i) {
+		for (auto& [root, flags] : words.bucket_data(i)) {
+			candidates.push_back(root);
+			expand(expand, root, flags, 0, 0);
+			if (candidates.size() > max_forms)
+				return stats;
+		}
+	}
+	sort(begin(candidates), end(candidates));
+	candidates.erase(unique(begin(candidates), end(candidates)),
+	                 end(candidates));
+	stats.candidates = candidates.size();
+
+	auto forms = vector<Word_Form_Dawg::Form>();
+	for (auto& c : candidates) {
+		auto a = check_simple_word(c, ACCEPT_HIDDEN_HOMONYM);
+		auto b = check_simple_word(c, SKIP_HIDDEN_HOMONYM);
+		if (a || b)
+			forms.push_back({move(c), a, b});
+	}
+	candidates = {};
+	word_form_dawg.build(forms);
+
+	stats.built = true;
+	stats.forms = forms.size();
+	stats.nodes = word_form_dawg.num_nodes();
+	stats.edges = word_form_dawg.num_edges();
+	stats.memory = word_form_dawg.memory();
+	stats.build_time = chrono::steady_clock::now() - start_time;
+	return stats;
+}
+
 template <class AffixT>
 class To_Root_Unroot_RAII {
       private:
@@ -1516,15 +1752,20 @@ auto Dict_Base::check_compound(std::wstring& word,
 
 	if (compound_flag || compound_begin_flag || compound_middle_flag ||
 	    compound_last_flag) {
-		auto ret =
-		    check_compound(word, 0, 0, part, allow_bad_forceucase);
+		// Compound checks do not nest, so the thread reuses one memo.
+		auto static thread_local memo = Compounding_Memo();
+		memo.start(word.size());
+		AT_SCOPE_EXIT(compounding_counters() += memo.counters;
+		              memo.finish());
+		auto ret = check_compound(word, 0, 0, part,
+		                          allow_bad_forceucase, memo);
 		if (ret)
 			return ret;
 	}
 	if (!compound_rules.empty()) {
-		auto words_data = vector<const Flag_Set*>();
-		return check_compound_with_rules(word, words_data, 0, part,
-		                                 allow_bad_forceucase);
+		return check_compound_with_rules(
+		    word, compound_rules.initial_state(), 0, part,
+		    allow_bad_forceucase);
 	}
 
 	return {};
@@ -1533,7 +1774,8 @@ auto Dict_Base::check_compound(std::wstring& word,
 template <Affixing_Mode m>
 auto Dict_Base::check_compound(std::wstring& word, size_t start_pos,
                                size_t num_part, std::wstring& part,
-                               Forceucase allow_bad_forceucase) const
+                               Forceucase allow_bad_forceucase,
+                               Compounding_Memo& memo) const
     -> Compounding_Result
 {
 	size_t min_length = 3;
@@ -1541,34 +1783,48 @@ auto Dict_Base::check_compound(std::wstring& word, size_t start_pos,
 		min_length = compound_min_length;
 	if (word.size() < min_length * 2)
 		return {};
-	size_t max_length = word.size() - min_length;
-	for (auto i = start_pos + min_length; i <= max_length; ++i) {
 
-		auto part1_entry = check_compound_classic<m>(
-		    word, start_pos, i, num_part, part, allow_bad_forceucase);
+	// The result for the rest of the word depends only on the split
+	// position and the number of parts found so far. Remember it, so
+	// each subproblem is solved only once.
+	Compounding_Memo::Entry* memo_entry = nullptr;
+	if (m == AT_COMPOUND_MIDDLE)
+		memo_entry = memo.find_compound(start_pos, num_part);
+	if (memo_entry && memo_entry->known)
+		return memo_entry->result;
 
-		if (part1_entry)
-			return part1_entry;
+	auto ret = Compounding_Result();
+	size_t max_length = word.size() - min_length;
+	for (auto i = start_pos + min_length; i <= max_length; ++i) {
 
-		part1_entry = check_compound_with_pattern_replacements<m>(
-		    word, start_pos, i, num_part, part, allow_bad_forceucase);
+		ret = check_compound_classic<m>(word, start_pos, i, num_part,
+		                                part, allow_bad_forceucase,
+		                                memo);
+		if (ret)
+			break;
 
-		if (part1_entry)
-			return part1_entry;
+		ret = check_compound_with_pattern_replacements<m>(
+		    word, start_pos, i, num_part, part, allow_bad_forceucase,
+		    memo);
+		if (ret)
+			break;
 	}
-	return {};
+	if (memo_entry)
+		*memo_entry = {true, ret};
+	return ret;
 }
 
 template <Affixing_Mode m>
 auto Dict_Base::check_compound_classic(std::wstring& word, size_t start_pos,
                                        size_t i, size_t num_part,
                                        std::wstring& part,
-                                       Forceucase allow_bad_forceucase) const
+                                       Forceucase allow_bad_forceucase,
+                                       Compounding_Memo& memo) const
     -> Compounding_Result
 {
 	auto old_num_part = num_part;
-	part.assign(word, start_pos, i - start_pos);
-	auto part1_entry = check_word_in_compound<m>(part);
+	auto part1_entry =
+	    check_word_in_compound<m>(word, start_pos, i, part, memo);
 	if (!part1_entry)
 		return {};
 	if (part1_entry->second.contains(forbiddenword_flag))
@@ -1588,8 +1844,8 @@ auto Dict_Base::check_compound_classic(std::wstring& word, size_t start_pos,
 	num_part += compound_root_flag &&
 	            part1_entry->second.contains(compound_root_flag);
 
-	part.assign(word, i, word.npos);
-	auto part2_entry = check_word_in_compound<AT_COMPOUND_END>(part);
+	auto part2_entry = check_word_in_compound<AT_COMPOUND_END>(
+	    word, i, word.size(), part, memo);
 	if (!part2_entry)
 		goto try_recursive;
 	if (part2_entry->second.contains(forbiddenword_flag))
@@ -1629,7 +1885,7 @@ auto Dict_Base::check_compound_classic(std::wstring& word, size_t start_pos,
 
 try_recursive:
 	part2_entry = check_compound<AT_COMPOUND_MIDDLE>(
-	    word, i, num_part + 1, part, allow_bad_forceucase);
+	    word, i, num_part + 1, part, allow_bad_forceucase, memo);
 	if (!part2_entry)
 		goto try_simplified_triple;
 	if (is_compound_forbidden_by_patterns(compound_patterns, word, i,
@@ -1659,7 +1915,8 @@ try_simplified_triple:
 	if (!(i >= 2 && word[i - 1] == word[i - 2]))
 		return {};
 	word.insert(i, 1, word[i - 1]);
-	AT_SCOPE_EXIT(word.erase(i, 1));
+	memo.begin_word_modification();
+	AT_SCOPE_EXIT(word.erase(i, 1); memo.end_word_modification());
 	part.assign(word, i, word.npos);
 	part2_entry = check_word_in_compound<AT_COMPOUND_END>(part);
 	if (!part2_entry)
@@ -1692,7 +1949,7 @@ try_simplified_triple:
 
 try_simplified_triple_recursive:
 	part2_entry = check_compound<AT_COMPOUND_MIDDLE>(
-	    word, i, num_part + 1, part, allow_bad_forceucase);
+	    word, i, num_part + 1, part, allow_bad_forceucase, memo);
 	if (!part2_entry)
 		return {};
 	if (is_compound_forbidden_by_patterns(compound_patterns, word, i,
@@ -1720,8 +1977,8 @@ try_simplified_triple_recursive:
 template <Affixing_Mode m>
 auto Dict_Base::check_compound_with_pattern_replacements(
     std::wstring& word, size_t start_pos, size_t i, size_t num_part,
-    std::wstring& part, Forceucase allow_bad_forceucase) const
-    -> Compounding_Result
+    std::wstring& part, Forceucase allow_bad_forceucase,
+    Compounding_Memo& memo) const -> Compounding_Result
 {
 	for (auto& p : compound_patterns) {
 		if (p.replacement.empty())
@@ -1732,10 +1989,12 @@ auto Dict_Base::check_compound_with_pattern_replacements(
 		// at this point p.replacement is substring in word
 		word.replace(i, p.replacement.size(), p.begin_end_chars.str());
 		i += p.begin_end_chars.idx();
+		memo.begin_word_modification();
 		AT_SCOPE_EXIT({
 			i -= p.begin_end_chars.idx();
 			word.replace(i, p.begin_end_chars.str().size(),
 			             p.replacement);
+			memo.end_word_modification();
 		});
 
 		part.assign(word, start_pos, i - start_pos);
@@ -1788,7 +2047,7 @@ auto Dict_Base::check_compound_with_pattern_replacements(
 
 	try_recursive:
 		part2_entry = check_compound<AT_COMPOUND_MIDDLE>(
-		    word, i, num_part + 1, part, allow_bad_forceucase);
+		    word, i, num_part + 1, part, allow_bad_forceucase, memo);
 		if (!part2_entry)
 			goto try_simplified_triple;
 		if (p.second_word_flag != 0 &&
@@ -1851,7 +2110,7 @@ auto Dict_Base::check_compound_with_pattern_replacements(
 
 	try_simplified_triple_recursive:
 		part2_entry = check_compound<AT_COMPOUND_MIDDLE>(
-		    word, i, num_part + 1, part, allow_bad_forceucase);
+		    word, i, num_part + 1, part, allow_bad_forceucase, memo);
 		if (!part2_entry)
 			continue;
 		if (p.second_word_flag != 0 &&
@@ -1936,6 +2195,30 @@ auto Dict_Base::check_word_in_compound(std::wstring& word) const
 	return {};
 }
 
+template <Affixing_Mode m>
+auto Dict_Base::check_word_in_compound(const std::wstring& word, size_t start,
+                                       size_t end, std::wstring& part,
+                                       Compounding_Memo& memo) const
+    -> Compounding_Result
+{
+	auto memo_entry = memo.find_part(m, start, end);
+	if (memo_entry && memo_entry->known)
+		return memo_entry->result;
+	auto ret = Compounding_Result();
+	auto part_view = std::wstring_view(word).substr(start, end - start);
+	if (compound_part_index.may_be_part(part_view)) {
+		++memo.counters.parts_checked;
+		part = part_view;
+		ret = check_word_in_compound<m>(part);
+	}
+	else {
+		++memo.counters.parts_pruned;
+	}
+	if (memo_entry)
+		*memo_entry = {true, ret};
+	return ret;
+}
+
 auto Dict_Base::calc_num_words_modifier(const Prefix<wchar_t>& pfx) const
     -> unsigned char
 {
@@ -1997,7 +2280,7 @@ auto Dict_Base::count_syllables(const std::wstring& word) const -> size_t
 }
 
 auto Dict_Base::check_compound_with_rules(
-    std::wstring& word, std::vector<const Flag_Set*>& words_data,
+    std::wstring& word, const Compound_Rule_Table::State& rules_state,
     size_t start_pos, std::wstring& part, Forceucase allow_bad_forceucase) const
     -> Compounding_Result
 {
@@ -2006,6 +2289,8 @@ auto Dict_Base::check_compound_with_rules(
 		min_length = compound_min_length;
 	if (word.size() < min_length * 2)
 		return {};
+	auto state1 = Compound_Rule_Table::State();
+	auto state2 = Compound_Rule_Table::State();
 	size_t max_length = word.size() - min_length;
 	for (auto i = start_pos + min_length; i <= max_length; ++i) {
 
@@ -2023,8 +2308,10 @@ auto Dict_Base::check_compound_with_rules(
 		}
 		if (!part1_entry)
 			continue;
-		words_data.push_back(&part1_entry->second);
-		AT_SCOPE_EXIT(words_data.pop_back());
+		// No rule can match the words so far, don't look further.
+		if (!compound_rules.advance(rules_state, part1_entry->second,
+		                            state1))
+			continue;
 
 		part.assign(word, i, word.npos);
 		auto part2_entry = Word_List::const_pointer();
@@ -2040,24 +2327,22 @@ auto Dict_Base::check_compound_with_rules(
 		}
 		if (!part2_entry)
 			goto try_recursive;
+		if (!compound_rules.advance(state1, part2_entry->second,
+		                            state2))
+			goto try_recursive;
+		if (!compound_rules.is_accepting(state2))
+			goto try_recursive;
+		if (compound_force_uppercase && !allow_bad_forceucase &&
+		    part2_entry->second.contains(compound_force_uppercase))
+			goto try_recursive;
 
-		{
-			words_data.push_back(&part2_entry->second);
-			AT_SCOPE_EXIT(words_data.pop_back());
-
-			auto m = compound_rules.match_any_rule(words_data);
-			if (!m)
-				goto try_recursive;
-			if (compound_force_uppercase && !allow_bad_forceucase &&
-			    part2_entry->second.contains(
-			        compound_force_uppercase))
-				goto try_recursive;
+		return {part1_entry};
 
-			return {part1_entry};
-		}
 	try_recursive:
+		if (!compound_rules.can_advance(state1))
+			continue;
 		part2_entry = check_compound_with_rules(
-		    word, words_data, i, part, allow_bad_forceucase);
+		    word, state1, i, part, allow_bad_forceucase);
 		if (part2_entry)
 			return {part2_entry};
 	}
@@ -2066,7 +2351,7 @@ auto Dict_Base::check_compound_with_rules(
 
 auto static insert_sug_first(const wstring& word, List_WStrings& out)
 {
-		out.insert(begin(out), word);
+	out.insert(begin(out), word);
 }
 
 auto& operator|=(Dict_Base::High_Quality_Sugs& lhs,
@@ -2094,12 +2379,42 @@ auto Dict_Base::suggest_priv(std::wstring& word, List_WStrings& out) const
 	auto backup = Short_WString(word);
 	auto casing = classify_casing(word);
 	auto hq_sugs = High_Quality_Sugs();
+
+	// Only the outermost call streams suggestions, the recursive calls for
+	// the parts of dashed words must not.
+	auto& hook = new_suggestions_hook();
+	auto& sink = suggestion_sink();
+	auto parent_hook = hook;
+	auto own_sink = move(sink);
+	auto own_hook = New_Suggestions_Hook();
+	hook = nullptr;
+	sink = nullptr;
+	AT_SCOPE_EXIT(hook = parent_hook; sink = move(own_sink));
+	if (own_sink) {
+		own_hook = [&](const List_WStrings& sugs, size_t first,
+		               size_t last) {
+			auto sug = wstring();
+			for (auto i = first; i != last; ++i) {
+				sug = sugs[i];
+				if (preview_suggestion(sug, casing, backup))
+					own_sink(sug);
+			}
+		};
+		hook = &own_hook;
+	}
+	auto notify_first = [&]() {
+		if (hook)
+			(*hook)(out, 0, 1);
+	};
+
 	switch (casing) {
 	case Casing::SMALL:
 		if (compound_force_uppercase &&
 		    check_compound(word, ALLOW_BAD_FORCEUCASE)) {
 			to_title(word, icu_locale, word);
 			out.push_back(word);
+			if (hook)
+				(*hook)(out, out.size() - 1, out.size());
 			word = backup;
 			return;
 		}
@@ -2120,46 +2435,44 @@ auto Dict_Base::suggest_priv(std::wstring& word, List_WStrings& out) const
 			if (casing_after_dot == Casing::INIT_CAPITAL) {
 				word.insert(dot_idx + 1, 1, ' ');
 				insert_sug_first(word, out);
+				notify_first();
 				word.erase(dot_idx + 1, 1);
 			}
 		}
 		if (casing == Casing::PASCAL) {
 			to_lower_char_at(word, 0, icu_locale);
-			if (spell_priv(word))
+			if (spell_priv(word)) {
 				insert_sug_first(word, out);
+				notify_first();
+			}
 			hq_sugs |= suggest_low(word, out);
 		}
 		to_lower(backup, icu_locale, word);
-		if (spell_priv(word))
+		if (spell_priv(word)) {
 			insert_sug_first(word, out);
+			notify_first();
+		}
 		hq_sugs |= suggest_low(word, out);
 		if (casing == Casing::PASCAL) {
 			to_title(backup, icu_locale, word);
-			if (spell_priv(word))
+			if (spell_priv(word)) {
 				insert_sug_first(word, out);
+				notify_first();
+			}
 			hq_sugs |= suggest_low(word, out);
 		}
 		for (auto it = begin(out); it != end(out); ++it) {
-			auto& sug = *it;
-			auto space_idx = sug.find(' ');
-			if (space_idx == sug.npos)
-				continue;
-			auto i = space_idx + 1;
-			auto len = sug.size() - i;
-			if (len > backup.size())
-				continue;
-			if (sug.compare(i, len, backup, backup.size() - len) ==
-			    0)
-				continue;
-			to_title_char_at(sug, i, icu_locale);
-			rotate(begin(out), it, it + 1);
+			if (title_word_after_space(*it, backup))
+				rotate(begin(out), it, it + 1);
 		}
 		break;
 	}
 	case Casing::ALL_CAPITAL:
 		to_lower(backup, icu_locale, word);
-		if (keepcase_flag != 0 && spell_priv(word))
+		if (keepcase_flag != 0 && spell_priv(word)) {
 			insert_sug_first(word, out);
+			notify_first();
+		}
 		hq_sugs |= suggest_low(word, out);
 		to_title(backup, icu_locale, word);
 		hq_sugs |= suggest_low(word, out);
@@ -2174,7 +2487,7 @@ auto Dict_Base::suggest_priv(std::wstring& word, List_WStrings& out) const
 		else
 			to_lower(backup, icu_locale, word);
 		auto old_size = out.size();
-		ngram_suggest(word, out);
+		run_suggest_stage(Suggest_Stage::NGRAM, word, out);
 		if (casing == Casing::ALL_CAPITAL) {
 			for (auto i = old_size; i != out.size(); ++i)
 				to_upper(out[i], icu_locale, out[i]);
@@ -2188,6 +2501,8 @@ auto Dict_Base::suggest_priv(std::wstring& word, List_WStrings& out) const
 		    return s.find('-') != s.npos;
 	    });
 	if (has_dash && !has_dash_sug) {
+		auto old_size = out.size();
+		AT_SCOPE_EXIT(if (hook) (*hook)(out, old_size, out.size()));
 		auto sugs_tmp = List_WStrings();
 		auto i = size_t();
 		for (;;) {
@@ -2221,68 +2536,194 @@ auto Dict_Base::suggest_priv(std::wstring& word, List_WStrings& out) const
 
 	if ((casing == Casing::INIT_CAPITAL || casing == Casing::ALL_CAPITAL) &&
 	    (keepcase_flag != 0 || forbiddenword_flag != 0)) {
-		auto is_ok = [&](wstring& s) {
-			if (s.find(' ') != s.npos)
-				return true;
-			if (spell_priv(s))
-				return true;
-			to_lower(s, icu_locale, s);
-			if (spell_priv(s))
-				return true;
-			to_title(s, icu_locale, s);
-			return spell_priv(s);
-		};
 		auto it = begin(out);
 		auto last = end(out);
 		// Bellow is remove_if(it, last, is_not_ok);
-		// We don't use remove_if because is_ok modifies
+		// We don't use remove_if because is_ok_with_casing modifies
 		// the argument.
 		for (; it != last; ++it)
-			if (!is_ok(*it))
+			if (!is_ok_with_casing(*it))
 				break;
 		if (it != last) {
 			for (auto it2 = it + 1; it2 != last; ++it2)
-				if (is_ok(*it2))
+				if (is_ok_with_casing(*it2))
 					*it++ = move(*it2);
 			out.erase(it, last);
 		}
 	}
-	{
-		auto it = begin(out);
-		auto last = end(out);
-		for (; it != last; ++it)
-			last = remove(it + 1, last, *it);
-		out.erase(last, end(out));
-	}
+	List_WStrings_Set::remove_duplicates(out);
 	for (auto& sug : out)
 		output_substr_replacer.replace(sug);
 }
 
+/**
+ * @brief Applies to one raw suggestion the final processing of suggest_priv().
+ *
+ * Used for streaming the suggestions before the full list is ready. It does
+ * not reorder or deduplicate.
+ *
+ * @param sug raw suggestion, modified in place
+ * @param casing casing of the misspelled word
+ * @param orig_word misspelled word, after input conversion
+ * @return false if the suggestion is filtered out
+ */
+auto Dict_Base::preview_suggestion(std::wstring& sug, Casing casing,
+                                   std::wstring_view orig_word) const -> bool
+{
+	if (casing == Casing::CAMEL || casing == Casing::PASCAL)
+		title_word_after_space(sug, orig_word);
+	if (casing == Casing::ALL_CAPITAL)
+		to_upper(sug, icu_locale, sug);
+	if (casing == Casing::INIT_CAPITAL || casing == Casing::PASCAL)
+		to_title_char_at(sug, 0, icu_locale);
+	if ((casing == Casing::INIT_CAPITAL || casing == Casing::ALL_CAPITAL) &&
+	    (keepcase_flag != 0 || forbiddenword_flag != 0) &&
+	    !is_ok_with_casing(sug))
+		return false;
+	output_substr_replacer.replace(sug);
+	return true;
+}
+
+/**
+ * @brief Capitalizes the second word of a two word suggestion for a camel or
+ * pascal case word, unless it is the same as the end of the original word.
+ *
+ * @return true if the suggestion was changed
+ */
+auto Dict_Base::title_word_after_space(std::wstring& sug,
+                                       std::wstring_view orig_word) const
+    -> bool
+{
+	auto space_idx = sug.find(' ');
+	if (space_idx == sug.npos)
+		return false;
+	auto i = space_idx + 1;
+	auto len = sug.size() - i;
+	if (len > orig_word.size())
+		return false;
+	if (sug.compare(i, len, orig_word, orig_word.size() - len) == 0)
+		return false;
+	to_title_char_at(sug, i, icu_locale);
+	return true;
+}
+
+/**
+ * @brief Checks a suggestion for a capitalized word when keepcase or
+ * forbidden words are used, trying also its lower and title case.
+ *
+ * @param sug suggestion, may be changed to the casing that is correct
+ */
+auto Dict_Base::is_ok_with_casing(std::wstring& sug) const -> bool
+{
+	if (sug.find(' ') != sug.npos)
+		return true;
+	if (spell_priv(sug))
+		return true;
+	to_lower(sug, icu_locale, sug);
+	if (spell_priv(sug))
+		return true;
+	to_title(sug, icu_locale, sug);
+	return spell_priv(sug);
+}
+
 auto Dict_Base::suggest_low(std::wstring& word, List_WStrings& out) const
     -> High_Quality_Sugs
 {
+	using S = Suggest_Stage;
+	// The order of Hunspell, which gives the expected order of suggestions.
+	auto static constexpr full_order = {
+	    S::ADJACENT_SWAP, S::DISTANT_SWAP,      S::KEYBOARD,
+	    S::EXTRA_CHAR,    S::FORGOTTEN_CHAR,    S::MOVE_CHAR,
+	    S::BAD_CHAR,      S::DOUBLED_TWO_CHARS, S::TWO_WORDS,
+	    S::PHONETIC};
+	// With limited budget, the stages that find most suggestions per
+	// checked candidate go first. The quadratic ones go last.
+	auto static constexpr budget_order = {
+	    S::ADJACENT_SWAP,     S::EXTRA_CHAR, S::KEYBOARD,
+	    S::DOUBLED_TWO_CHARS, S::TWO_WORDS,  S::FORGOTTEN_CHAR,
+	    S::BAD_CHAR,          S::MOVE_CHAR,  S::DISTANT_SWAP,
+	    S::PHONETIC};
+
 	auto ret = ALL_LOW_QUALITY_SUGS;
 	auto old_size = out.size();
-	uppercase_suggest(word, out);
-	rep_suggest(word, out);
-	map_suggest(word, out);
+	run_suggest_stage(S::UPPERCASE, word, out);
+	run_suggest_stage(S::REP, word, out);
+	run_suggest_stage(S::MAP, word, out);
 	ret = High_Quality_Sugs(old_size != out.size());
-	adjacent_swap_suggest(word, out);
-	distant_swap_suggest(word, out);
-	keyboard_suggest(word, out);
-	extra_char_suggest(word, out);
-	forgotten_char_suggest(word, out);
-	move_char_suggest(word, out);
-	bad_char_suggest(word, out);
-	doubled_two_chars_suggest(word, out);
-	two_words_suggest(word, out);
-	phonetic_suggest(word, out);
+	auto& order =
+	    suggest_budget().is_limited() ? budget_order : full_order;
+	for (auto stage : order)
+		run_suggest_stage(stage, word, out);
 	return ret;
 }
 
+auto Dict_Base::run_suggest_stage(Suggest_Stage stage, std::wstring& word,
+                                  List_WStrings& out) const -> void
+{
+	auto& budget = suggest_budget();
+	auto refusals = budget.num_refusals();
+	if (budget.exhausted()) {
+		budget.skip(stage);
+		return;
+	}
+	auto old_size = out.size();
+	switch (stage) {
+	case Suggest_Stage::UPPERCASE:
+		uppercase_suggest(word, out);
+		break;
+	case Suggest_Stage::REP:
+		rep_suggest(word, out);
+		break;
+	case Suggest_Stage::MAP:
+		map_suggest(word, out);
+		break;
+	case Suggest_Stage::ADJACENT_SWAP:
+		adjacent_swap_suggest(word, out);
+		break;
+	case Suggest_Stage::DISTANT_SWAP:
+		distant_swap_suggest(word, out);
+		break;
+	case Suggest_Stage::KEYBOARD:
+		keyboard_suggest(word, out);
+		break;
+	case Suggest_Stage::EXTRA_CHAR:
+		extra_char_suggest(word, out);
+		break;
+	case Suggest_Stage::FORGOTTEN_CHAR:
+		forgotten_char_suggest(word, out);
+		break;
+	case Suggest_Stage::MOVE_CHAR:
+		move_char_suggest(word, out);
+		break;
+	case Suggest_Stage::BAD_CHAR:
+		bad_char_suggest(word, out);
+		break;
+	case Suggest_Stage::DOUBLED_TWO_CHARS:
+		doubled_two_chars_suggest(word, out);
+		break;
+	case Suggest_Stage::TWO_WORDS:
+		two_words_suggest(word, out);
+		break;
+	case Suggest_Stage::PHONETIC:
+		phonetic_suggest(word, out);
+		break;
+	case Suggest_Stage::NGRAM:
+		ngram_suggest(word, out);
+		break;
+	}
+	// the budget ran out in the middle of the stage
+	if (budget.num_refusals() != refusals)
+		budget.skip(stage);
+	auto hook = new_suggestions_hook();
+	if (hook && old_size != out.size())
+		(*hook)(out, old_size, out.size());
+}
+
 auto Dict_Base::add_sug_if_correct(std::wstring& word, List_WStrings& out) const
     -> bool
 {
+	if (!suggest_budget().add_candidate())
+		return false;
 	auto res = check_word(word, FORBID_BAD_FORCEUCASE, SKIP_HIDDEN_HOMONYM);
 	if (!res)
 		return false;
@@ -2304,47 +2745,22 @@ auto Dict_Base::uppercase_suggest(std::wstring& word, List_WStrings& out) const
 }
 
 auto Dict_Base::rep_suggest(std::wstring& word, List_WStrings& out) const
-
     -> void
 {
-	auto& reps = replacements;
-	for (auto& r : reps.whole_word_replacements()) {
-		auto& from = r.first;
-		auto& to = r.second;
-		if (word == from) {
-			word = to;
-			try_rep_suggestion(word, out);
-			word = from;
-		}
-	}
-	for (auto& r : reps.start_word_replacements()) {
-		auto& from = r.first;
-		auto& to = r.second;
-		if (begins_with(word, from)) {
-			word.replace(0, from.size(), to);
-			try_rep_suggestion(word, out);
-			word.replace(0, to.size(), from);
-		}
-	}
-	for (auto& r : reps.end_word_replacements()) {
-		auto& from = r.first;
-		auto& to = r.second;
-		if (ends_with(word, from)) {
-			auto pos = word.size() - from.size();
-			word.replace(pos, word.npos, to);
-			try_rep_suggestion(word, out);
-			word.replace(pos, word.npos, from);
-		}
-	}
-	for (auto& r : reps.any_place_replacements()) {
-		auto& from = r.first;
-		auto& to = r.second;
-		for (auto i = word.find(from); i != word.npos;
-		     i = word.find(from, i + 1)) {
-			word.replace(i, from.size(), to);
-			try_rep_suggestion(word, out);
-			word.replace(i, to.size(), from);
-		}
+	using Rep_Match = pair<const pair<wstring, wstring>*, size_t>;
+	auto matches = boost::container::small_vector<Rep_Match, 16>();
+	replacements.for_each_match(word, [&](auto& r, size_t i) {
+		matches.emplace_back(&r, i);
+		return false;
+	});
+	// Try them in table order, and for each entry from left to right.
+	sort(begin(matches), end(matches));
+	for (auto& [r, i] : matches) {
+		auto& from = r->first;
+		auto& to = r->second;
+		word.replace(i, from.size(), to);
+		try_rep_suggestion(word, out);
+		word.replace(i, to.size(), from);
 	}
 }
 
@@ -2370,59 +2786,56 @@ auto Dict_Base::try_rep_suggestion(std::wstring& word, List_WStrings& out) const
 
 auto Dict_Base::is_rep_similar(std::wstring& word) const -> bool
 {
-	auto& reps = replacements;
-	for (auto& r : reps.whole_word_replacements()) {
-		auto& from = r.first;
-		auto& to = r.second;
-		if (word == from) {
-			word = to;
-			auto ret = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
-			word = from;
-			if (ret)
-				return true;
-		}
-	}
-	for (auto& r : reps.start_word_replacements()) {
-		auto& from = r.first;
-		auto& to = r.second;
-		if (begins_with(word, from)) {
-			word.replace(0, from.size(), to);
-			auto ret = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
-			word.replace(0, to.size(), from);
-			if (ret)
-				return true;
-		}
-	}
-	for (auto& r : reps.end_word_replacements()) {
-		auto& from = r.first;
-		auto& to = r.second;
-		if (ends_with(word, from)) {
-			auto pos = word.size() - from.size();
-			word.replace(pos, word.npos, to);
-			auto ret = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
-			word.replace(pos, word.npos, from);
-			if (ret)
-				return true;
-		}
-	}
-	for (auto& r : reps.any_place_replacements()) {
+	auto ret = false;
+	auto backup = Short_WString(word);
+	auto try_rep = [&](auto& r, size_t i) {
 		auto& from = r.first;
 		auto& to = r.second;
-		for (auto i = word.find(from); i != word.npos;
-		     i = word.find(from, i + 1)) {
-			word.replace(i, from.size(), to);
-			auto ret = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
-			word.replace(i, to.size(), from);
-			if (ret)
-				return true;
-		}
-	}
-	return false;
+		word.replace(i, from.size(), to);
+		ret = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
+		word.replace(i, to.size(), from);
+		return ret;
+	};
+	replacements.for_each_match(wstring_view(backup), try_rep);
+	return ret;
 }
 
-auto Dict_Base::map_suggest(std::wstring& word, List_WStrings& out,
-                            size_t i) const -> void
+auto Dict_Base::map_suggest(std::wstring& word, List_WStrings& out) const
+    -> void
 {
+	// Hard limit for words with very many mappable characters.
+	auto remaining_nodes = size_t(10000);
+	map_suggest(word, out, 0, remaining_nodes);
+}
+
+/**
+ * @brief Recursive part of map_suggest().
+ *
+ * Substitutions are done only from position i onwards, so a branch where
+ * the beginning of the word up to the last substitution can not begin any
+ * dictionary word is cut.
+ *
+ * @param word word to do substitutions in
+ * @param out list where the correct candidates are added
+ * @param i position where to start doing substitutions
+ * @param remaining_nodes limit on the number of tried candidates, shared by
+ * the whole search
+ */
+auto Dict_Base::map_suggest(std::wstring& word, List_WStrings& out, size_t i,
+                            size_t& remaining_nodes) const -> void
+{
+	if (suggest_budget().exhausted())
+		return;
+	auto try_candidate = [&](size_t next_i) {
+		if (remaining_nodes == 0)
+			return;
+		--remaining_nodes;
+		auto fixed = wstring_view(word).substr(0, next_i);
+		if (!word_prefix_index.may_be_prefix(fixed))
+			return;
+		add_sug_if_correct(word, out);
+		map_suggest(word, out, next_i, remaining_nodes);
+	};
 	for (; i != word.size(); ++i) {
 		for (auto& e : similarities) {
 			auto j = e.chars.find(word[i]);
@@ -2432,14 +2845,12 @@ auto Dict_Base::map_suggest(std::wstring& word, List_WStrings& out,
 				if (c == e.chars[j])
 					continue;
 				word[i] = c;
-				add_sug_if_correct(word, out);
-				map_suggest(word, out, i + 1);
+				try_candidate(i + 1);
 				word[i] = e.chars[j];
 			}
 			for (auto& r : e.strings) {
 				word.replace(i, 1, r);
-				add_sug_if_correct(word, out);
-				map_suggest(word, out, i + r.size());
+				try_candidate(i + r.size());
 				word.replace(i, r.size(), 1, e.chars[j]);
 			}
 		try_find_strings:
@@ -2448,16 +2859,14 @@ auto Dict_Base::map_suggest(std::wstring& word, List_WStrings& out,
 					continue;
 				for (auto c : e.chars) {
 					word.replace(i, f.size(), 1, c);
-					add_sug_if_correct(word, out);
-					map_suggest(word, out, i + 1);
+					try_candidate(i + 1);
 					word.replace(i, 1, f);
 				}
 				for (auto& r : e.strings) {
 					if (f == r)
 						continue;
 					word.replace(i, f.size(), r);
-					add_sug_if_correct(word, out);
-					map_suggest(word, out, i + r.size());
+					try_candidate(i + r.size());
 					word.replace(i, r.size(), f);
 				}
 			}
@@ -2465,31 +2874,68 @@ auto Dict_Base::map_suggest(std::wstring& word, List_WStrings& out,
 	}
 }
 
+/**
+ * @brief Tells which edits of a word can be dictionary words.
+ *
+ * Uses the optional deletion index to get the word forms within the given
+ * distance once, so the edits that are not among them are rejected without
+ * checking them. If the index is not built for that distance, all edits are
+ * accepted.
+ */
+class Near_Forms {
+	bool active = false;
+	vector<wstring_view> forms;
+
+      public:
+	Near_Forms(const Deletion_Index& index, wstring_view word,
+	           size_t distance)
+	{
+		active = distance <= index.max_distance();
+		if (active)
+			index.near_forms(word, distance, forms);
+	}
+	auto is_active() const { return active; }
+	auto may_contain(wstring_view edited_word) const -> bool
+	{
+		if (!active)
+			return true;
+		return binary_search(begin(forms), end(forms), edited_word);
+	}
+};
+
 auto Dict_Base::adjacent_swap_suggest(std::wstring& word,
                                       List_WStrings& out) const -> void
 {
 	using std::swap;
 	if (word.empty())
 		return;
+	auto near = Near_Forms(deletion_index, word, 1);
 	for (size_t i = 0; i != word.size() - 1; ++i) {
 		swap(word[i], word[i + 1]);
-		add_sug_if_correct(word, out);
+		if (near.may_contain(word))
+			add_sug_if_correct(word, out);
 		swap(word[i], word[i + 1]);
 	}
+	if (word.size() != 4 && word.size() != 5)
+		return;
+	auto near2 = Near_Forms(deletion_index, word, 2);
 	if (word.size() == 4) {
 		swap(word[0], word[1]);
 		swap(word[2], word[3]);
-		add_sug_if_correct(word, out);
+		if (near2.may_contain(word))
+			add_sug_if_correct(word, out);
 		swap(word[0], word[1]);
 		swap(word[2], word[3]);
 	}
 	else if (word.size() == 5) {
 		swap(word[0], word[1]);
 		swap(word[3], word[4]);
-		add_sug_if_correct(word, out);
+		if (near2.may_contain(word))
+			add_sug_if_correct(word, out);
 		swap(word[0], word[1]); // revert first two
 		swap(word[1], word[2]);
-		add_sug_if_correct(word, out);
+		if (near2.may_contain(word))
+			add_sug_if_correct(word, out);
 		swap(word[1], word[2]);
 		swap(word[3], word[4]);
 	}
@@ -2501,10 +2947,12 @@ auto Dict_Base::distant_swap_suggest(std::wstring& word,
 	using std::swap;
 	if (word.size() < 3)
 		return;
+	auto near = Near_Forms(deletion_index, word, 2);
 	for (size_t i = 0; i != word.size() - 2; ++i) {
 		for (size_t j = i + 2; j != word.size(); ++j) {
 			swap(word[i], word[j]);
-			add_sug_if_correct(word, out);
+			if (near.may_contain(word))
+				add_sug_if_correct(word, out);
 			swap(word[i], word[j]);
 		}
 	}
@@ -2540,21 +2988,69 @@ auto Dict_Base::keyboard_suggest(std::wstring& word, List_WStrings& out) const
 auto Dict_Base::extra_char_suggest(std::wstring& word, List_WStrings& out) const
     -> void
 {
+	auto near = Near_Forms(deletion_index, word, 1);
 	for (auto i = word.size() - 1; i != size_t(-1); --i) {
 		auto c = word[i];
 		word.erase(i, 1);
-		add_sug_if_correct(word, out);
+		if (near.may_contain(word))
+			add_sug_if_correct(word, out);
 		word.insert(i, 1, c);
 	}
 }
 
+/**
+ * @brief Tells which characters can be put at a position in a word.
+ *
+ * A character put at position i can give a correct word only if the first i
+ * characters of the word followed by it can begin a dictionary word. The
+ * characters that can follow are looked up once per position, so testing a
+ * candidate is cheaper than checking the whole word.
+ */
+class Next_Char_Filter {
+	bool guided = false;
+	vector<wstring> next_chars;
+
+      public:
+	Next_Char_Filter() = default;
+	Next_Char_Filter(const Word_Prefix_Index& index, wstring_view word)
+	{
+		auto chars = wstring();
+		guided = index.next_chars(wstring_view(), chars);
+		if (!guided)
+			return;
+		for (size_t i = 0;; ++i) {
+			next_chars.push_back(chars);
+			if (i == word.size() ||
+			    !binary_search(begin(chars), end(chars), word[i]))
+				break;
+			index.next_chars(word.substr(0, i + 1), chars);
+		}
+	}
+	auto may_put(size_t i, wchar_t c) const -> bool
+	{
+		if (!guided)
+			return true;
+		if (i >= next_chars.size())
+			return false;
+		auto& n = next_chars[i];
+		return binary_search(begin(n), end(n), c);
+	}
+};
+
 auto Dict_Base::forgotten_char_suggest(std::wstring& word,
                                        List_WStrings& out) const -> void
 {
+	auto near = Near_Forms(deletion_index, word, 1);
+	auto filter = near.is_active()
+	                  ? Next_Char_Filter()
+	                  : Next_Char_Filter(word_prefix_index, word);
 	for (auto new_c : try_chars) {
 		for (auto i = word.size(); i != size_t(-1); --i) {
+			if (!filter.may_put(i, new_c))
+				continue;
 			word.insert(i, 1, new_c);
-			add_sug_if_correct(word, out);
+			if (near.may_contain(word))
+				add_sug_if_correct(word, out);
 			word.erase(i, 1);
 		}
 	}
@@ -2589,13 +3085,18 @@ auto Dict_Base::move_char_suggest(std::wstring& word,
 auto Dict_Base::bad_char_suggest(std::wstring& word, List_WStrings& out) const
     -> void
 {
+	auto near = Near_Forms(deletion_index, word, 1);
+	auto filter = near.is_active()
+	                  ? Next_Char_Filter()
+	                  : Next_Char_Filter(word_prefix_index, word);
 	for (auto new_c : try_chars) {
 		for (size_t i = 0; i != word.size(); ++i) {
 			auto c = word[i];
-			if (c == new_c)
+			if (c == new_c || !filter.may_put(i, new_c))
 				continue;
 			word[i] = new_c;
-			add_sug_if_correct(word, out);
+			if (near.may_contain(word))
+				add_sug_if_correct(word, out);
 			word[i] = c;
 		}
 	}
@@ -2628,34 +3129,56 @@ auto Dict_Base::two_words_suggest(std::wstring& word, List_WStrings& out) const
 
 	auto backup_str = Short_WString(word);
 	auto backup = wstring_view(backup_str);
-	word.erase();
-	for (size_t i = 0; i != backup.size() - 1; ++i) {
-		word += backup[i];
-		// TODO: maybe switch to check_word()
-		auto w1 = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
-		if (!w1)
-			continue;
-		auto sz1 = i + 1;
+	auto& budget = suggest_budget();
+	auto sugs_set = List_WStrings_Set(out);
+
+	// sz1 is the length of the first word, which is known to be correct
+	auto add_split = [&](size_t sz1) {
 		auto sz2 = backup.size() - sz1;
-		word.assign(backup, i + 1, sz2);
+		word.assign(backup, sz1, sz2);
 		auto w2 = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
-		word.assign(backup, 0, sz1);
 		if (!w2)
-			continue;
+			return;
+		word.assign(backup, 0, sz1);
 		word += ' ';
-		word.append(backup, i + 1, sz2);
-		if (find(begin(out), end(out), word) == end(out))
+		word.append(backup, sz1, sz2);
+		if (!sugs_set.contains(word))
 			out.push_back(word);
 		if (sz1 > 1 && sz2 > 1 && !try_chars.empty() &&
 		    (try_chars.find('a') != try_chars.npos ||
 		     try_chars.find('-') != try_chars.npos)) {
-			word[i + 1] = '-';
-			if (find(begin(out), end(out), word) == end(out))
+			word[sz1] = '-';
+			if (!sugs_set.contains(word))
 				out.push_back(word);
 		}
-		word.erase(i + 1);
+	};
+	if (!word_form_dawg.empty() && word_form_dawg.complete()) {
+		// All beginnings that are correct are found with one walk.
+		auto lengths = vector<size_t>();
+		auto all_but_last = backup.substr(0, backup.size() - 1);
+		word_form_dawg.prefix_lengths(all_but_last, SKIP_HIDDEN_HOMONYM,
+		                              lengths);
+		for (auto sz1 : lengths) {
+			if (!budget.add_candidate())
+				break;
+			add_split(sz1);
+		}
+		word = backup;
+		return;
 	}
-	word += backup.back();
+	// The first word can not be longer than what can begin a word.
+	auto max_sz1 = word_prefix_index.max_prefix_length(backup);
+	max_sz1 = min(max_sz1, backup.size() - 1);
+	for (size_t i = 0; i != max_sz1; ++i) {
+		if (!budget.add_candidate())
+			break;
+		word.assign(backup, 0, i + 1);
+		// TODO: maybe switch to check_word()
+		auto w1 = check_simple_word(word, SKIP_HIDDEN_HOMONYM);
+		if (w1)
+			add_split(i + 1);
+	}
+	word = backup;
 }
 
 auto Dict_Base::phonetic_suggest(std::wstring& word, List_WStrings& out) const
@@ -2830,7 +3353,10 @@ auto Dict_Base::ngram_suggest(std::wstring& word, List_WStrings& out) const
 	auto backup = Short_WString(word);
 	auto wrong_word = wstring_view(backup);
 	auto roots = vector<Word_Entry_And_Score>();
+	auto& budget = suggest_budget();
 	for (size_t bucket = 0; bucket != words.bucket_count(); ++bucket) {
+		if (bucket % 256 == 0 && budget.exhausted())
+			break;
 		for (auto& word_entry : words.bucket_data(bucket)) {
 			auto& [dict_word, flags] = word_entry;
 			if (flags.contains(forbiddenword_flag) ||
@@ -2871,6 +3397,8 @@ auto Dict_Base::ngram_suggest(std::wstring& word, List_WStrings& out) const
 	auto expanded_cross_afx = vector<bool>();
 	auto guess_words = vector<Word_And_Score>();
 	for (auto& root : roots) {
+		if (budget.exhausted())
+			break;
 		expand_root_word_for_ngram(*root.word_entry, wrong_word,
 		                           expanded_list, expanded_cross_afx);
 		for (auto& expanded_word : expanded_list) {
@@ -2945,6 +3473,7 @@ auto Dict_Base::ngram_suggest(std::wstring& word, List_WStrings& out) const
 	auto old_num_sugs = out.size();
 	auto max_sug =
 	    min(MAX_SUGGESTIONS, old_num_sugs + max_ngram_suggestions);
+	auto sugs_set = List_WStrings_Set(out);
 	for (auto& [guess_word, score] : guess_words) {
 		if (out.size() == max_sug)
 			break;
@@ -2953,9 +3482,7 @@ auto Dict_Base::ngram_suggest(std::wstring& word, List_WStrings& out) const
 		if (score < -100 &&
 		    (old_num_sugs != out.size() || only_max_diff))
 			break;
-		if (any_of(begin(out), end(out), [& g = guess_word](auto& sug) {
-			    return g.find(sug) != g.npos;
-		    })) {
+		if (sugs_set.contains_substring_of(guess_word)) {
 			if (score < -100)
 				break;
 			else
@@ -2963,6 +3490,90 @@ auto Dict_Base::ngram_suggest(std::wstring& word, List_WStrings& out) const
 		}
 		out.push_back(move(guess_word));
 	}
+	if (!phonetic_index.empty())
+		phonetic_ngram_suggest(word, out);
+}
+
+/**
+ * @brief Suggests the roots that sound similar to the misspelled word.
+ *
+ * This is the phonetic part of the ngram suggestions of Hunspell, but the
+ * candidate roots come from the phonetic index instead of coding every root.
+ * The roots are ranked by how similar their codes are to the code of the
+ * word, and the best of them again by how similar they are to the word.
+ * It is done only if the optional phonetic index is built.
+ *
+ * @param word misspelled word in lower case
+ * @param out list to append the suggestions to
+ */
+auto Dict_Base::phonetic_ngram_suggest(std::wstring& word,
+                                       List_WStrings& out) const -> void
+{
+	auto static constexpr MAX_ROOTS = size_t(100);
+	auto static constexpr MAX_PHONETIC_SUGGESTIONS = size_t(2);
+	if (out.size() >= MAX_SUGGESTIONS || suggest_budget().exhausted())
+		return;
+	auto backup = Short_WString(word);
+	auto wrong_word = wstring_view(backup);
+	auto target = wstring();
+	Phonetic_Index::code(phonetic_table, wrong_word, target);
+	auto candidates = vector<const Phonetic_Index::Entry*>();
+	phonetic_index.similar(target, candidates);
+
+	struct Root_And_Score {
+		const wstring* root;
+		ptrdiff_t score;
+	};
+	auto roots = vector<Root_And_Score>();
+	for (auto e : candidates) {
+		auto& [code, root] = *e;
+		auto len_diff = ptrdiff_t(root.size() - wrong_word.size());
+		if (abs(len_diff) > 3)
+			continue;
+		auto score = 2 * ngram_similarity_longer_worse(3, target, code);
+		roots.push_back({&root, score});
+	}
+	auto by_score = [](auto& a, auto& b) { return a.score > b.score; };
+	stable_sort(begin(roots), end(roots), by_score);
+	// Of the best roots by code, keep those that are also a bit similar
+	// by spelling. Comparing the codes is cheaper, so it goes first.
+	auto& lower_root = word;
+	auto it = begin(roots);
+	for (auto& r : roots) {
+		if (it - begin(roots) == MAX_ROOTS)
+			break;
+		to_lower(*r.root, icu_locale, lower_root);
+		auto score = left_common_substring_length(wrong_word, *r.root) +
+		             ngram_similarity_longer_worse(3, wrong_word,
+		                                           lower_root);
+		if (score > 2)
+			*it++ = r;
+	}
+	roots.erase(it, end(roots));
+
+	auto lcs_state = vector<size_t>();
+	for (auto& [root, score] : roots) {
+		to_lower(*root, icu_locale, lower_root);
+		score += 2 * longest_common_subsequence_length(
+		                 wrong_word, lower_root, lcs_state);
+		score -= abs(ptrdiff_t(root->size() - wrong_word.size()));
+		score += left_common_substring_length(wrong_word, lower_root);
+	}
+	stable_sort(begin(roots), end(roots), by_score);
+
+	auto sugs_set = List_WStrings_Set(out);
+	auto old_size = out.size();
+	for (auto& r : roots) {
+		if (out.size() == MAX_SUGGESTIONS ||
+		    out.size() - old_size == MAX_PHONETIC_SUGGESTIONS)
+			break;
+		// skip the roots that contain a previous suggestion
+		if (sugs_set.contains_substring_of(*r.root))
+			continue;
+		word = *r.root;
+		add_sug_if_correct(word, out);
+	}
+	word = backup;
 }
 
 auto Dict_Base::expand_root_word_for_ngram(
@@ -3056,7 +3667,7 @@ Dictionary::Dictionary(std::istream& aff, std::istream& dic)
 		throw Dictionary_Loading_Error("error parsing");
 }
 
-auto Dictionary::external_to_internal_encoding(const string& in,
+auto Dictionary::external_to_internal_encoding(string_view in,
                                                wstring& wide_out) const -> bool
 {
 	if (external_locale_known_utf8)
@@ -3075,6 +3686,26 @@ auto Dictionary::internal_to_external_encoding(const wstring& wide_in,
 	return true;
 }
 
+/**
+ * @brief Converts a word that is to be checked or corrected.
+ *
+ * Words longer than 180 code units are rejected, and the buffer that grew for
+ * them is released.
+ *
+ * @return false if the word can not be correct
+ */
+auto Dictionary::external_to_internal_word(string_view in,
+                                           wstring& wide_out) const -> bool
+{
+	auto ok_enc = external_to_internal_encoding(in, wide_out);
+	if (unlikely(wide_out.size() > 180)) {
+		wide_out.resize(180);
+		wide_out.shrink_to_fit();
+		return false;
+	}
+	return ok_enc;
+}
+
 Dictionary::Dictionary() : external_locale_known_utf8(true) {}
 
 /**
@@ -3120,6 +3751,167 @@ auto Dictionary::load_from_path(const std::string& file_path_without_extension)
 	return load_from_aff_dic(aff_file, dic_file);
 }
 
+struct Dictionary_Future::State {
+	Dictionary dic;
+	Load_Counters counters;
+	size_t bytes_total = 0;
+	mutex mtx;
+	condition_variable stage_changed;
+	Load_Stage stage = Load_Stage::PARSING;
+	exception_ptr error;
+
+	auto set_stage(Load_Stage s, exception_ptr e = nullptr) -> void
+	{
+		{
+			auto lock = lock_guard<mutex>(mtx);
+			stage = s;
+			error = e;
+		}
+		stage_changed.notify_all();
+	}
+	auto wait_for_stage(Load_Stage s) -> void
+	{
+		auto lock = unique_lock<mutex>(mtx);
+		stage_changed.wait(lock, [&]() { return stage >= s; });
+		if (stage == Load_Stage::FAILED)
+			rethrow_exception(error);
+	}
+};
+
+/**
+ * @brief Create a dictionary from files in a background thread
+ *
+ * The files are opened before returning and parsed in the background. As
+ * soon as the word list is loaded, the dictionary can check words with
+ * Dictionary_Future::spell(), while the optional indexes for suggestions
+ * requested in the options are still being built.
+ *
+ * @param file_path_without_extension path *without* extensions (without .dic
+ * or .aff)
+ * @param options optional indexes to build
+ * @return handle to the dictionary being loaded
+ * @throws Dictionary_Loading_Error if the files can not be opened. Errors
+ * while parsing are thrown by the functions of the returned handle.
+ */
+auto Dictionary::load_async(const std::string& file_path_without_extension,
+                            const Load_Options& options) -> Dictionary_Future
+{
+	auto path = file_path_without_extension;
+	path += ".aff";
+	auto aff_file = std::ifstream(path, ios_base::ate);
+	if (aff_file.fail()) {
+		auto err = "Aff file " + path + " not found";
+		throw Dictionary_Loading_Error(err);
+	}
+	path.replace(path.size() - 3, 3, "dic");
+	auto dic_file = std::ifstream(path, ios_base::ate);
+	if (dic_file.fail()) {
+		auto err = "Dic file " + path + " not found";
+		throw Dictionary_Loading_Error(err);
+	}
+	auto aff_size = max<streamoff>(aff_file.tellg(), 0);
+	auto dic_size = max<streamoff>(dic_file.tellg(), 0);
+	aff_file.seekg(0);
+	dic_file.seekg(0);
+
+	auto ret = Dictionary_Future();
+	ret.state = make_shared<Dictionary_Future::State>();
+	ret.state->bytes_total = aff_size + dic_size;
+	auto load = [st = ret.state, aff = move(aff_file),
+	             dic = move(dic_file), aff_size, options]() mutable {
+		auto& d = st->dic;
+		d.load_counters = &st->counters;
+		try {
+			if (!d.parse_aff(aff))
+				throw Dictionary_Loading_Error("error parsing");
+			st->counters.bytes_parsed = aff_size;
+			if (!d.parse_dic(dic))
+				throw Dictionary_Loading_Error("error parsing");
+			d.load_counters = nullptr;
+			st->counters.bytes_parsed = st->bytes_total;
+			d.build_indexes();
+			st->set_stage(Load_Stage::SPELL_READY);
+			// spell checking does not read these indexes
+			if (options.word_prefix_index)
+				d.build_word_prefix_index();
+			if (options.phonetic_index)
+				d.build_phonetic_index();
+			auto distance = options.deletion_distance;
+			if (distance != 0)
+				d.build_deletion_index(distance);
+			st->set_stage(Load_Stage::READY);
+		}
+		catch (...) {
+			d.load_counters = nullptr;
+			st->set_stage(Load_Stage::FAILED, current_exception());
+		}
+	};
+	ret.task = async(launch::async, move(load));
+	return ret;
+}
+
+/**
+ * @brief Gets the current stage and progress of the loading.
+ */
+auto Dictionary_Future::progress() const -> Load_Progress
+{
+	auto ret = Load_Progress();
+	{
+		auto lock = lock_guard<mutex>(state->mtx);
+		ret.stage = state->stage;
+	}
+	ret.bytes_parsed = state->counters.bytes_parsed;
+	ret.bytes_total = state->bytes_total;
+	ret.words_inserted = state->counters.words_inserted;
+	return ret;
+}
+
+/**
+ * @brief Waits until spell() can be used.
+ * @throws Dictionary_Loading_Error if the loading failed
+ */
+auto Dictionary_Future::wait_spell_ready() const -> void
+{
+	state->wait_for_stage(Load_Stage::SPELL_READY);
+}
+
+/**
+ * @brief Checks if a given word is correct, waiting for the word list.
+ *
+ * It can be used before the loading finishes, from any thread.
+ *
+ * @see Dictionary::spell()
+ * @throws Dictionary_Loading_Error if the loading failed
+ */
+auto Dictionary_Future::spell(std::string_view word) const -> bool
+{
+	wait_spell_ready();
+	return state->dic.spell(word);
+}
+
+/**
+ * @brief Waits until the loading finishes.
+ * @throws Dictionary_Loading_Error if the loading failed
+ */
+auto Dictionary_Future::wait() const -> void
+{
+	state->wait_for_stage(Load_Stage::READY);
+}
+
+/**
+ * @brief Gets the loaded dictionary, waiting for the loading to finish.
+ *
+ * The dictionary stays alive as long as the returned pointer, even after
+ * this handle is destroyed.
+ *
+ * @throws Dictionary_Loading_Error if the loading failed
+ */
+auto Dictionary_Future::get() const -> std::shared_ptr<const Dictionary>
+{
+	wait();
+	return {state, &state->dic};
+}
+
 /**
  * @brief Sets external (public API) encoding
  *
@@ -3150,25 +3942,118 @@ auto Dictionary::imbue(const locale& loc) -> void
  */
 auto Dictionary::imbue_utf8() -> void { external_locale_known_utf8 = true; }
 
+/**
+ * @brief Adds a word, like a word of a personal dictionary
+ *
+ * The word is accepted with the usual casing rules and is suggested. It is
+ * accepted with affixes too if a model word is given, then it gets the same
+ * affixes as the model. The lookup indexes are updated with the word, but
+ * the automaton of word forms is not rebuilt, words that it does not have
+ * are looked up slower. For adding many words prefer
+ * load_personal_dictionary().
+ *
+ * This function is not thread-safe, don't call it while other threads use
+ * the dictionary.
+ *
+ * @param word the word to add
+ * @param model optional dictionary word whose affixes the word gets
+ * @return false if the word was not added or the model was not found
+ */
+auto Dictionary::add_word(std::string_view word, std::string_view model)
+    -> bool
+{
+	auto wide_word = wstring();
+	auto wide_model = wstring();
+	if (!external_to_internal_encoding(word, wide_word) ||
+	    !external_to_internal_encoding(model, wide_model) ||
+	    wide_word.empty())
+		return false;
+	return add_personal_word(wide_word, wide_model);
+}
+
+/**
+ * @brief Adds the words of a personal dictionary
+ *
+ * Each line holds a word, optionally followed by a slash and a model word,
+ * e.g. "foo/bar". Then the word gets the same affixes as the model. A slash
+ * that is part of the word is escaped with a backslash, like in .dic files,
+ * e.g. "TCP\/IP". The lines must be in the external encoding. The word list
+ * grows and the lookup indexes are rebuilt once per call. Can be called
+ * multiple times.
+ *
+ * This function is not thread-safe, don't call it while other threads use
+ * the dictionary.
+ *
+ * @param in the stream of the personal dictionary
+ * @return true if the whole stream was read
+ */
+auto Dictionary::load_personal_dictionary(std::istream& in) -> bool
+{
+	auto line = string();
+	auto wide_word = wstring();
+	auto wide_model = wstring();
+	// pairs of word and model, collected to grow the word list only once
+	auto new_words = vector<pair<wstring, wstring>>();
+	while (getline(in, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		auto slash = size_t(0);
+		for (;;) {
+			slash = line.find('/', slash + 1);
+			if (slash == line.npos || line[slash - 1] != '\\')
+				break;
+			line.erase(--slash, 1);
+		}
+		auto line_view = string_view(line);
+		auto model = string_view();
+		if (slash != line_view.npos) {
+			model = line_view.substr(slash + 1);
+			line_view = line_view.substr(0, slash);
+		}
+		if (!external_to_internal_encoding(line_view, wide_word) ||
+		    !external_to_internal_encoding(model, wide_model) ||
+		    wide_word.empty())
+			continue;
+		new_words.emplace_back(wide_word, wide_model);
+	}
+	if (!new_words.empty())
+		add_personal_words(new_words);
+	return in.eof();
+}
+
 /**
  * @brief Checks if a given word is correct
  * @param word any word
  * @return true if correct, false otherwise
  */
-auto Dictionary::spell(const std::string& word) const -> bool
+auto Dictionary::spell(std::string_view word) const -> bool
 {
 	auto static thread_local wide_word = wstring();
-	auto ok_enc = external_to_internal_encoding(word, wide_word);
-	if (unlikely(wide_word.size() > 180)) {
-		wide_word.resize(180);
-		wide_word.shrink_to_fit();
-		return false;
-	}
-	if (unlikely(!ok_enc))
+	if (unlikely(!external_to_internal_word(word, wide_word)))
 		return false;
 	return spell_priv(wide_word);
 }
 
+/**
+ * @brief Checks if a given word is correct
+ * @param word any word
+ * @return true if correct, false otherwise
+ */
+auto Dictionary::spell(const std::string& word) const -> bool
+{
+	return spell(string_view(word));
+}
+
+/**
+ * @brief Checks if a given word is correct
+ * @param word any word, null-terminated
+ * @return true if correct, false otherwise
+ */
+auto Dictionary::spell(const char* word) const -> bool
+{
+	return spell(string_view(word));
+}
+
 /**
  * @brief Suggests correct words for a given incorrect word
  * @param[in] word incorrect word
@@ -3177,18 +4062,52 @@ auto Dictionary::spell(const std::string& word) const -> bool
 auto Dictionary::suggest(const std::string& word,
                          std::vector<std::string>& out) const -> void
 {
-	auto static thread_local wide_word = wstring();
-	auto static thread_local wide_list = List_WStrings();
+	suggest(word, out, Suggest_Options());
+}
 
-	auto ok_enc = external_to_internal_encoding(word, wide_word);
-	if (unlikely(wide_word.size() > 180)) {
-		wide_word.resize(180);
-		wide_word.shrink_to_fit();
-		return;
+/**
+ * @brief Suggests correct words for a given incorrect word, limiting the work
+ *
+ * When the budget in the options is exhausted, the remaining suggestion
+ * strategies are skipped and the suggestions found so far are returned. With
+ * a limited budget the cheaper strategies run first, so the order of the
+ * suggestions may differ from the unlimited case.
+ *
+ * @param[in] word incorrect word
+ * @param[out] out this object will be populated with the suggestions
+ * @param[in] options limits on time and number of checked candidates
+ * @return statistics including which strategies were skipped
+ */
+auto Dictionary::suggest(const std::string& word, std::vector<std::string>& out,
+                         const Suggest_Options& options) const
+    -> Suggest_Report
+{
+	// The state is per call, on_suggestion may call suggest() again.
+	auto wide_word = wstring();
+	auto wide_list = List_WStrings();
+
+	if (unlikely(!external_to_internal_word(word, wide_word)))
+		return {};
+	auto& budget = suggest_budget();
+	auto parent_budget = move(budget);
+	budget = Suggest_Budget(options);
+	AT_SCOPE_EXIT(budget = move(parent_budget));
+	auto& sink = suggestion_sink();
+	auto parent_sink = move(sink);
+	auto streamed = unordered_set<string>();
+	if (options.on_suggestion) {
+		sink = [&](const wstring& sug) {
+			auto s = string();
+			internal_to_external_encoding(sug, s);
+			auto [it, inserted] = streamed.insert(move(s));
+			if (inserted)
+				options.on_suggestion(*it);
+		};
 	}
-	if (unlikely(!ok_enc))
-		return;
-	wide_list.clear();
+	else {
+		sink = nullptr;
+	}
+	AT_SCOPE_EXIT(sink = move(parent_sink));
 	suggest_priv(wide_word, wide_list);
 
 	auto narrow_list = List_Strings(move(out));
@@ -3198,5 +4117,119 @@ auto Dictionary::suggest(const std::string& word,
 		internal_to_external_encoding(w, o);
 	}
 	out = narrow_list.extract_sequence();
+	return budget.get_report();
+}
+
+/**
+ * @brief Sets external (public API) encoding of all dictionaries
+ * @param loc locale object with valid codecvt<wchar_t, char, mbstate_t>
+ * @see Dictionary::imbue()
+ */
+auto Dictionary_Set::imbue(const locale& loc) -> void
+{
+	for (auto& d : dics)
+		d.imbue(loc);
+}
+
+/**
+ * @brief Sets external (public API) encoding of all dictionaries to UTF-8
+ */
+auto Dictionary_Set::imbue_utf8() -> void
+{
+	for (auto& d : dics)
+		d.imbue_utf8();
+}
+
+/**
+ * @brief Checks if a given word is correct in any of the dictionaries
+ *
+ * Stops at the first dictionary that accepts the word. The dictionary that
+ * accepted the previous word in the calling thread is tried first, as
+ * consecutive words tend to be in the same language. The conversion from
+ * UTF-8 is done once for all dictionaries.
+ *
+ * @param word any word
+ * @return true if correct, false otherwise
+ */
+auto Dictionary_Set::spell(std::string_view word) const -> bool
+{
+	auto static thread_local wide_word = wstring();
+	auto static thread_local work_word = wstring();
+	auto static thread_local last_hit =
+	    pair<const Dictionary_Set*, size_t>();
+
+	auto n = dics.size();
+	if (n == 1)
+		return dics[0].spell(word);
+	auto first = size_t(0);
+	if (last_hit.first == this && last_hit.second < n)
+		first = last_hit.second;
+	auto converted = false;
+	auto ok_enc = false;
+	for (size_t k = 0; k != n; ++k) {
+		auto i = (first + k) % n;
+		auto& d = dics[i];
+		auto correct = false;
+		if (d.external_locale_known_utf8) {
+			if (!converted) {
+				ok_enc = d.external_to_internal_word(
+				    word, wide_word);
+				converted = true;
+			}
+			if (unlikely(!ok_enc))
+				continue;
+			// spell_priv() modifies its argument
+			work_word = wide_word;
+			correct = d.spell_priv(work_word);
+		}
+		else {
+			correct = d.spell(word);
+		}
+		if (correct) {
+			last_hit = {this, i};
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Suggests correct words for a given incorrect word
+ *
+ * The dictionaries are asked one after the other in the calling thread, so
+ * the per-thread suggestion limits apply to each of them. The results are
+ * interleaved, so the best suggestions of every dictionary come first.
+ * Duplicates are removed.
+ *
+ * @param[in] word incorrect word
+ * @param[out] out this object will be populated with the suggestions
+ */
+auto Dictionary_Set::suggest(const std::string& word,
+                             std::vector<std::string>& out) const -> void
+{
+	out.clear();
+	auto n = dics.size();
+	if (n == 0)
+		return;
+	if (n == 1) {
+		dics[0].suggest(word, out);
+		return;
+	}
+	auto lists = vector<vector<string>>(n);
+	for (size_t i = 0; i != n; ++i)
+		dics[i].suggest(word, lists[i]);
+	for (size_t j = 0;; ++j) {
+		auto any = false;
+		for (auto& list : lists) {
+			if (j >= list.size())
+				continue;
+			any = true;
+			auto& sug = list[j];
+			if (find(begin(out), end(out), sug) == end(out))
+				out.push_back(move(sug));
+		}
+		if (!any)
+			break;
+	}
 }
 } // namespace nuspell
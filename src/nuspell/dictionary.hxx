@@ -26,10 +26,16 @@
 
 #include "aff_data.hxx"
 
+#include <chrono>
+#include <functional>
+#include <future>
 #include <locale>
+#include <memory>
 
 namespace nuspell {
-inline namespace v3 {
+enum class Casing : char; // utils.hxx
+
+inline namespace v4 {
 
 enum Affixing_Mode {
 	FULL_WORD,
@@ -86,6 +92,242 @@ struct Compounding_Result {
 	auto operator-> () const { return word_entry; }
 };
 
+/**
+ * @brief Counters of the word parts looked up while checking compounds.
+ */
+struct Compounding_Counters {
+	size_t parts_checked = 0; /**< parts looked up in the dictionary */
+	size_t parts_pruned = 0;  /**< parts skipped by Compound_Part_Index */
+
+	auto& operator+=(const Compounding_Counters& other)
+	{
+		parts_checked += other.parts_checked;
+		parts_pruned += other.parts_pruned;
+		return *this;
+	}
+};
+
+/**
+ * @brief Memoization table used during one compound check of a word.
+ *
+ * Remembers the results of checking word parts and of the recursive search
+ * for the rest of the compound at a given split position, so the compound
+ * checking is done with dynamic programming instead of exhaustive search.
+ * Entries are only valid for the original word, while the word is temporarily
+ * modified (pattern replacements, simplified triple) the memo is disabled.
+ *
+ * The tables are kept between checks and only grow. start() and finish()
+ * bracket one check, finish() resets only the entries that were used.
+ */
+class Compounding_Memo {
+      public:
+	struct Entry {
+		bool known = false;
+		Compounding_Result result = {};
+	};
+
+      private:
+	size_t n = 0;
+	size_t modified_depth = 0;
+	std::vector<Entry> begin_parts;
+	std::vector<Entry> middle_parts;
+	std::vector<Entry> end_parts;
+	std::vector<Entry> middle_compounds;
+	std::vector<Entry*> touched;
+
+	auto get(std::vector<Entry>& v, size_t idx) -> Entry*
+	{
+		auto e = &v[idx];
+		if (!e->known)
+			touched.push_back(e);
+		return e;
+	}
+
+      public:
+	Compounding_Counters counters;
+
+	/**
+	 * @brief Prepares the memo for checking a word of the given size.
+	 */
+	auto start(size_t word_size) -> void
+	{
+		n = word_size;
+		auto n2 = (n + 1) * (n + 1);
+		if (middle_parts.size() < n2) {
+			begin_parts.resize(n + 1);
+			middle_parts.resize(n2);
+			end_parts.resize(n + 1);
+			middle_compounds.resize(n2);
+		}
+		counters = {};
+	}
+
+	/**
+	 * @brief Resets the entries used since start().
+	 */
+	auto finish() -> void
+	{
+		for (auto e : touched)
+			*e = {};
+		touched.clear();
+		modified_depth = 0;
+	}
+
+	auto enabled() const { return modified_depth == 0; }
+	auto begin_word_modification() { ++modified_depth; }
+	auto end_word_modification() { --modified_depth; }
+
+	/**
+	 * @brief Finds the memo entry for a word part in a given position.
+	 * @return pointer to the entry, nullptr if the part can not be memoized
+	 */
+	auto find_part(Affixing_Mode m, size_t start, size_t end) -> Entry*
+	{
+		if (!enabled() || start > end || end > n)
+			return nullptr;
+		switch (m) {
+		case AT_COMPOUND_BEGIN:
+			if (start != 0)
+				return nullptr;
+			return get(begin_parts, end);
+		case AT_COMPOUND_MIDDLE:
+			return get(middle_parts, start * (n + 1) + end);
+		case AT_COMPOUND_END:
+			if (end != n)
+				return nullptr;
+			return get(end_parts, start);
+		default:
+			return nullptr;
+		}
+	}
+
+	/**
+	 * @brief Finds the memo entry for the compound search of the rest of
+	 * the word starting at start with num_part parts already found.
+	 */
+	auto find_compound(size_t start, size_t num_part) -> Entry*
+	{
+		if (!enabled() || start > n || num_part > n)
+			return nullptr;
+		return get(middle_compounds, start * (n + 1) + num_part);
+	}
+};
+
+/**
+ * @brief The strategies used for generating suggestions.
+ *
+ * Listed in the order they run when the suggestion budget is not limited.
+ */
+enum class Suggest_Stage : unsigned char {
+	UPPERCASE,
+	REP,
+	MAP,
+	ADJACENT_SWAP,
+	DISTANT_SWAP,
+	KEYBOARD,
+	EXTRA_CHAR,
+	FORGOTTEN_CHAR,
+	MOVE_CHAR,
+	BAD_CHAR,
+	DOUBLED_TWO_CHARS,
+	TWO_WORDS,
+	PHONETIC,
+	NGRAM
+};
+
+/**
+ * @brief Limits and callbacks for Dictionary::suggest().
+ *
+ * The default values do not limit anything.
+ */
+struct Suggest_Options {
+	/** time point after which no more candidates are checked */
+	std::chrono::steady_clock::time_point deadline =
+	    std::chrono::steady_clock::time_point::max();
+	/** maximal number of candidate words checked in the dictionary */
+	size_t max_candidates_checked = size_t(-1);
+	/** if set, called with each new suggestion as soon as it is found,
+	 * it may call Dictionary::suggest() again */
+	std::function<void(const std::string& suggestion)> on_suggestion;
+};
+
+/**
+ * @brief Statistics about one call of Dictionary::suggest().
+ */
+struct Suggest_Report {
+	size_t candidates_checked = 0;
+	bool budget_exhausted = false;
+	/** bit mask of the stages that were skipped or cut short */
+	unsigned skipped_stages = 0;
+
+	auto was_skipped(Suggest_Stage s) const -> bool
+	{
+		return skipped_stages >> unsigned(s) & 1u;
+	}
+};
+
+/**
+ * @brief Tracks the work done while suggesting against Suggest_Options.
+ */
+class Suggest_Budget {
+	Suggest_Options options;
+	Suggest_Report report;
+	bool limited = false;
+	bool has_deadline = false;
+	size_t refusals = 0;
+
+      public:
+	Suggest_Budget() = default;
+	Suggest_Budget(const Suggest_Options& opt)
+	    : options(opt),
+	      has_deadline(opt.deadline !=
+	                   std::chrono::steady_clock::time_point::max())
+	{
+		limited = has_deadline ||
+		          opt.max_candidates_checked != size_t(-1);
+	}
+	auto is_limited() const { return limited; }
+
+	/**
+	 * @brief Checks if the budget has been used up, before doing more
+	 * work.
+	 *
+	 * Every positive answer is counted as refused work.
+	 */
+	auto exhausted() -> bool
+	{
+		if (!limited)
+			return false;
+		auto& checked = report.candidates_checked;
+		if (!report.budget_exhausted &&
+		    (checked >= options.max_candidates_checked ||
+		     (has_deadline &&
+		      std::chrono::steady_clock::now() >= options.deadline)))
+			report.budget_exhausted = true;
+		refusals += report.budget_exhausted;
+		return report.budget_exhausted;
+	}
+	auto num_refusals() const { return refusals; }
+
+	/**
+	 * @brief Accounts for one candidate word before checking it.
+	 * @return false if the budget is exhausted and the candidate must not
+	 * be checked.
+	 */
+	auto add_candidate() -> bool
+	{
+		if (exhausted())
+			return false;
+		++report.candidates_checked;
+		return true;
+	}
+	auto skip(Suggest_Stage s) -> void
+	{
+		report.skipped_stages |= 1u << unsigned(s);
+	}
+	auto& get_report() const { return report; }
+};
+
 struct Dict_Base : public Aff_Data {
 
 	enum Forceucase : bool {
@@ -103,6 +345,15 @@ struct Dict_Base : public Aff_Data {
 		HAS_HIGH_QUALITY_SUGS = true
 	};
 
+	auto static compounding_counters() -> Compounding_Counters&;
+	auto static suggest_budget() -> Suggest_Budget&;
+
+	using New_Suggestions_Hook = std::function<void(
+	    const List_WStrings& sugs, size_t first, size_t last)>;
+	using Suggestion_Sink = std::function<void(const std::wstring& sug)>;
+	auto static new_suggestions_hook() -> const New_Suggestions_Hook*&;
+	auto static suggestion_sink() -> Suggestion_Sink&;
+
 	auto spell_priv(std::wstring& s) const -> bool;
 	auto spell_break(std::wstring& s, size_t depth = 0) const -> bool;
 	auto spell_casing(std::wstring& s) const -> const Flag_Set*;
@@ -117,6 +368,13 @@ struct Dict_Base : public Aff_Data {
 	auto check_simple_word(std::wstring& word,
 	                       Hidden_Homonym skip_hidden_homonym = {}) const
 	    -> const Flag_Set*;
+	auto build_word_form_dawg(size_t max_forms = 5000000)
+	    -> Word_Form_Dawg_Stats;
+	auto add_personal_word(std::wstring& word, const std::wstring& model)
+	    -> bool;
+	auto add_personal_words(
+	    std::vector<std::pair<std::wstring, std::wstring>>& new_words)
+	    -> void;
 
 	template <Affixing_Mode m>
 	auto affix_NOT_valid(const Prefix<wchar_t>& a) const;
@@ -295,26 +553,34 @@ struct Dict_Base : public Aff_Data {
 	template <Affixing_Mode m = AT_COMPOUND_BEGIN>
 	auto check_compound(std::wstring& word, size_t start_pos,
 	                    size_t num_part, std::wstring& part,
-	                    Forceucase allow_bad_forceucase) const
+	                    Forceucase allow_bad_forceucase,
+	                    Compounding_Memo& memo) const
 	    -> Compounding_Result;
 
 	template <Affixing_Mode m = AT_COMPOUND_BEGIN>
 	auto check_compound_classic(std::wstring& word, size_t start_pos,
 	                            size_t i, size_t num_part,
 	                            std::wstring& part,
-	                            Forceucase allow_bad_forceucase) const
+	                            Forceucase allow_bad_forceucase,
+	                            Compounding_Memo& memo) const
 	    -> Compounding_Result;
 
 	template <Affixing_Mode m = AT_COMPOUND_BEGIN>
 	auto check_compound_with_pattern_replacements(
 	    std::wstring& word, size_t start_pos, size_t i, size_t num_part,
-	    std::wstring& part, Forceucase allow_bad_forceucase) const
-	    -> Compounding_Result;
+	    std::wstring& part, Forceucase allow_bad_forceucase,
+	    Compounding_Memo& memo) const -> Compounding_Result;
 
 	template <Affixing_Mode m>
 	auto check_word_in_compound(std::wstring& s) const
 	    -> Compounding_Result;
 
+	template <Affixing_Mode m>
+	auto check_word_in_compound(const std::wstring& word, size_t start,
+	                            size_t end, std::wstring& part,
+	                            Compounding_Memo& memo) const
+	    -> Compounding_Result;
+
 	auto calc_num_words_modifier(const Prefix<wchar_t>& pfx) const
 	    -> unsigned char;
 
@@ -329,18 +595,27 @@ struct Dict_Base : public Aff_Data {
 
 	auto count_syllables(const std::wstring& word) const -> size_t;
 
-	auto check_compound_with_rules(std::wstring& word,
-	                               std::vector<const Flag_Set*>& words_data,
-	                               size_t start_pos, std::wstring& part,
-	                               Forceucase allow_bad_forceucase) const
-
-	    -> Compounding_Result;
+	auto check_compound_with_rules(
+	    std::wstring& word, const Compound_Rule_Table::State& rules_state,
+	    size_t start_pos, std::wstring& part,
+	    Forceucase allow_bad_forceucase) const -> Compounding_Result;
 
 	auto suggest_priv(std::wstring& word, List_WStrings& out) const -> void;
 
 	auto suggest_low(std::wstring& word, List_WStrings& out) const
 	    -> High_Quality_Sugs;
 
+	auto run_suggest_stage(Suggest_Stage stage, std::wstring& word,
+	                       List_WStrings& out) const -> void;
+
+	auto preview_suggestion(std::wstring& sug, Casing casing,
+	                        std::wstring_view orig_word) const -> bool;
+
+	auto title_word_after_space(std::wstring& sug,
+	                            std::wstring_view orig_word) const -> bool;
+
+	auto is_ok_with_casing(std::wstring& sug) const -> bool;
+
 	auto add_sug_if_correct(std::wstring& word, List_WStrings& out) const
 	    -> bool;
 
@@ -354,8 +629,10 @@ struct Dict_Base : public Aff_Data {
 
 	auto is_rep_similar(std::wstring& word) const -> bool;
 
-	auto map_suggest(std::wstring& word, List_WStrings& out,
-	                 size_t i = 0) const -> void;
+	auto map_suggest(std::wstring& word, List_WStrings& out) const -> void;
+
+	auto map_suggest(std::wstring& word, List_WStrings& out, size_t i,
+	                 size_t& remaining_nodes) const -> void;
 
 	auto adjacent_swap_suggest(std::wstring& word, List_WStrings& out) const
 	    -> void;
@@ -390,6 +667,9 @@ struct Dict_Base : public Aff_Data {
 	auto ngram_suggest(std::wstring& word, List_WStrings& out) const
 	    -> void;
 
+	auto phonetic_ngram_suggest(std::wstring& word,
+	                            List_WStrings& out) const -> void;
+
 	auto expand_root_word_for_ngram(Word_List::const_reference root,
 	                                std::wstring_view wrong,
 	                                List_WStrings& expanded_list,
@@ -411,6 +691,18 @@ class Dictionary_Loading_Error : public std::runtime_error {
 	using std::runtime_error::runtime_error;
 };
 
+class Dictionary_Future;
+
+/**
+ * @brief Optional indexes that Dictionary::load_async() builds in the
+ * background after the dictionary can check words.
+ */
+struct Load_Options {
+	bool word_prefix_index = false; /**< see build_word_prefix_index() */
+	bool phonetic_index = false;    /**< see build_phonetic_index() */
+	size_t deletion_distance = 0;   /**< 0 for no deletion index */
+};
+
 /**
  * @brief The only important public class
  */
@@ -419,12 +711,16 @@ class Dictionary : private Dict_Base {
 	bool external_locale_known_utf8;
 
 	Dictionary(std::istream& aff, std::istream& dic);
-	auto external_to_internal_encoding(const std::string& in,
+	auto external_to_internal_encoding(std::string_view in,
 	                                   std::wstring& wide_out) const
 	    -> bool;
 
 	auto internal_to_external_encoding(const std::wstring& wide_in,
 	                                   std::string& out) const -> bool;
+	auto external_to_internal_word(std::string_view in,
+	                               std::wstring& wide_out) const -> bool;
+
+	friend class Dictionary_Set;
 
       public:
 	Dictionary();
@@ -432,12 +728,95 @@ class Dictionary : private Dict_Base {
 	    -> Dictionary;
 	auto static load_from_path(
 	    const std::string& file_path_without_extension) -> Dictionary;
+	auto static load_async(const std::string& file_path_without_extension,
+	                       const Load_Options& options = {})
+	    -> Dictionary_Future;
 	auto imbue(const std::locale& loc) -> void;
 	auto imbue_utf8() -> void;
+	auto add_word(std::string_view word, std::string_view model = {})
+	    -> bool;
+	auto load_personal_dictionary(std::istream& in) -> bool;
+	auto spell(std::string_view word) const -> bool;
 	auto spell(const std::string& word) const -> bool;
+	auto spell(const char* word) const -> bool;
+	auto suggest(const std::string& word,
+	             std::vector<std::string>& out) const -> void;
+	auto suggest(const std::string& word, std::vector<std::string>& out,
+	             const Suggest_Options& options) const -> Suggest_Report;
+	using Dict_Base::build_deletion_index;
+	using Dict_Base::build_phonetic_index;
+	using Dict_Base::build_word_prefix_index;
+	using Dict_Base::build_word_form_dawg;
+	using Dict_Base::phonetic_index_stats;
+};
+
+/**
+ * @brief Stages of loading with Dictionary::load_async().
+ */
+enum class Load_Stage {
+	PARSING,     /**< the files are being parsed */
+	SPELL_READY, /**< spell() works, optional indexes are being built */
+	READY,       /**< loading finished */
+	FAILED       /**< loading failed */
+};
+
+/**
+ * @brief Snapshot of the progress of Dictionary::load_async().
+ */
+struct Load_Progress {
+	Load_Stage stage = Load_Stage::PARSING;
+	size_t bytes_parsed = 0;   /**< of the .aff and .dic files */
+	size_t bytes_total = 0;    /**< size of the .aff and .dic files */
+	size_t words_inserted = 0; /**< including hidden homonyms */
+};
+
+/**
+ * @brief Handle to a dictionary being loaded in a background thread.
+ *
+ * The destructor waits for the loading to finish, like the one of the
+ * std::future returned by std::async().
+ */
+class Dictionary_Future {
+	struct State;
+	std::shared_ptr<State> state;
+	std::future<void> task;
+
+	friend class Dictionary;
+
+      public:
+	Dictionary_Future() = default;
+	auto valid() const noexcept { return state != nullptr; }
+	auto progress() const -> Load_Progress;
+	auto wait_spell_ready() const -> void;
+	auto spell(std::string_view word) const -> bool;
+	auto wait() const -> void;
+	auto get() const -> std::shared_ptr<const Dictionary>;
+};
+
+/**
+ * @brief Several dictionaries used together, e.g. for multilingual text.
+ *
+ * A word is correct if any of the dictionaries accepts it.
+ */
+class Dictionary_Set {
+	std::vector<Dictionary> dics;
+
+      public:
+	Dictionary_Set() = default;
+	explicit Dictionary_Set(std::vector<Dictionary> dictionaries)
+	    : dics(std::move(dictionaries))
+	{
+	}
+	auto add(Dictionary dic) -> void { dics.push_back(std::move(dic)); }
+	auto size() const noexcept { return dics.size(); }
+	auto empty() const noexcept { return dics.empty(); }
+	auto& operator[](size_t i) const { return dics[i]; }
+	auto imbue(const std::locale& loc) -> void;
+	auto imbue_utf8() -> void;
+	auto spell(std::string_view word) const -> bool;
 	auto suggest(const std::string& word,
 	             std::vector<std::string>& out) const -> void;
 };
-} // namespace v3
+} // namespace v4
 } // namespace nuspell
 #endif // NUSPELL_DICTIONARY_HXX
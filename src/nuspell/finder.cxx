@@ -21,9 +21,16 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
 #include <iostream>
 #include <iterator>
 #include <sstream>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 
@@ -629,17 +636,253 @@ auto search_path_for_dicts(const string& dir, OutIt out) -> OutIt
 	return out;
 }
 
+using Dict_List = vector<pair<string, string>>;
+
+/**
+ * @brief Searches some of the directories for dictionaries, possibly in
+ * parallel.
+ *
+ * Listing directories mostly waits for the file system, so more threads can
+ * be used than there are processors.
+ *
+ * @param dirs directory paths
+ * @param which indexes in dirs of the directories to search
+ * @param out the found dictionaries, indexed like dirs
+ * @param max_threads the maximal number of threads, including the calling
+ */
+auto search_paths_for_dicts(const vector<string>& dirs,
+                            const vector<size_t>& which,
+                            vector<Dict_List>& out, size_t max_threads)
+    -> void
+{
+	auto next = atomic<size_t>(0);
+	auto work = [&]() {
+		for (size_t i; (i = next++) < which.size();) {
+			auto j = which[i];
+			search_path_for_dicts(dirs[j], back_inserter(out[j]));
+		}
+	};
+	auto threads = vector<thread>();
+	auto n_threads = min(which.size(), max_threads);
+	for (size_t i = 1; i < n_threads; ++i) {
+		try {
+			threads.emplace_back(work);
+		}
+		catch (const system_error&) {
+			break;
+		}
+	}
+	work();
+	for (auto& t : threads)
+		t.join();
+}
+
+/**
+ * @brief Joins the dictionaries found in each directory, sorted by name.
+ *
+ * Dictionaries with the same name stay in the order of the directories.
+ */
+auto merge_listings(const vector<Dict_List>& listings, Dict_List& out) -> void
+{
+	out.clear();
+	for (auto& l : listings)
+		out.insert(out.end(), l.begin(), l.end());
+	stable_sort(out.begin(), out.end(),
+	            [](auto& a, auto& b) { return a.first < b.first; });
+}
+
 /**
  * @brief Searches the added directories for dictionaries.
+ *
+ * The directories are listed one after the other in the calling thread.
  */
 auto Finder::search_for_dictionaries() -> void
 {
-	dictionaries.clear();
-	for (auto& path : paths) {
-		search_path_for_dicts(path, back_inserter(dictionaries));
+	auto start = chrono::steady_clock::now();
+	auto listings = vector<Dict_List>(paths.size());
+	auto all = vector<size_t>(paths.size());
+	for (size_t i = 0; i != all.size(); ++i)
+		all[i] = i;
+	search_paths_for_dicts(paths, all, listings, 1);
+	merge_listings(listings, dictionaries);
+	stats.directories = paths.size();
+	stats.from_cache = 0;
+	stats.cache_written = false;
+	stats.search_time = chrono::steady_clock::now() - start;
+}
+
+#ifdef _POSIX_VERSION
+namespace {
+auto const CACHE_HEADER = "nuspell dictionary cache 1";
+
+/**
+ * @brief Names of the dictionaries in a directory, as of its modification
+ * time.
+ */
+struct Cached_Dir {
+	time_t mtime = -1;
+	vector<string> names;
+};
+using Dir_Cache = unordered_map<string, Cached_Dir>;
+
+auto read_dir_cache(const string& file_name) -> Dir_Cache
+{
+	auto cache = Dir_Cache();
+	auto in = ifstream(file_name);
+	auto line = string();
+	if (!getline(in, line) || line != CACHE_HEADER)
+		return cache;
+	auto dir = static_cast<Cached_Dir*>(nullptr);
+	while (getline(in, line)) {
+		if (line.compare(0, 2, "d ") == 0) {
+			auto space = line.find(' ', 2);
+			if (space == line.npos)
+				return {};
+			auto mtime = strtoll(line.c_str() + 2, nullptr, 10);
+			dir = &cache[line.substr(space + 1)];
+			dir->mtime = time_t(mtime);
+			dir->names.clear();
+		}
+		else if (line.compare(0, 2, "n ") == 0 && dir) {
+			dir->names.push_back(line.substr(2));
+		}
+		else {
+			return {};
+		}
 	}
-	stable_sort(dictionaries.begin(), dictionaries.end(),
-	            [](auto& a, auto& b) { return a.first < b.first; });
+	return cache;
+}
+
+/**
+ * @brief Creates the parent directories of a file, like mkdir -p.
+ */
+auto create_parent_dirs(const string& file_name) -> void
+{
+	for (auto i = file_name.find('/', 1); i != file_name.npos;
+	     i = file_name.find('/', i + 1))
+		mkdir(file_name.substr(0, i).c_str(), 0755);
+}
+
+/**
+ * @brief Writes the cache to a temporary file and renames it, so readers
+ * never see a partially written cache.
+ */
+auto write_dir_cache(const string& file_name, const Dir_Cache& cache) -> bool
+{
+	create_parent_dirs(file_name);
+	auto tmp_name = file_name + '.' + to_string(getpid());
+	auto out = ofstream(tmp_name);
+	out << CACHE_HEADER << '\n';
+	for (auto& [path, dir] : cache) {
+		out << "d " << dir.mtime << ' ' << path << '\n';
+		for (auto& name : dir.names)
+			out << "n " << name << '\n';
+	}
+	out.close();
+	if (!out || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+		remove(tmp_name.c_str());
+		return false;
+	}
+	return true;
+}
+} // namespace
+#endif
+
+/**
+ * @brief Searches the added directories for dictionaries, using a cache.
+ *
+ * The cache holds the names of the dictionaries in each directory together
+ * with the modification time of the directory, which changes whenever a file
+ * is added, removed or renamed in it. Only the directories whose modification
+ * time differs from the cached one are listed again, the others take just a
+ * stat() call. The directories that are listed again are listed by up to
+ * eight threads. The cache is updated if anything changed. Directories given
+ * with relative paths, and directories modified in the last two seconds, as
+ * the time may have a resolution of a second, are always listed.
+ *
+ * The cache is supported only on POSIX systems. On others, or with empty
+ * cache_file, this is the same as search_for_dictionaries() without cache.
+ *
+ * @param cache_file path of the cache file, it and its parent directories
+ * are created if needed
+ */
+auto Finder::search_for_dictionaries(const std::string& cache_file) -> void
+{
+#ifdef _POSIX_VERSION
+	if (cache_file.empty()) {
+		search_for_dictionaries();
+		return;
+	}
+	auto start = chrono::steady_clock::now();
+	auto cache = read_dir_cache(cache_file);
+	auto new_cache = Dir_Cache();
+	auto now = time(nullptr);
+	auto listings = vector<Dict_List>(paths.size());
+	auto to_search = vector<size_t>();
+	auto mtimes = vector<time_t>(paths.size(), -1);
+	stats.from_cache = 0;
+	for (size_t i = 0; i != paths.size(); ++i) {
+		auto& path = paths[i];
+		struct stat dir_stat;
+		if (path.empty() || path[0] != '/' ||
+		    path.find('\n') != path.npos ||
+		    stat(path.c_str(), &dir_stat) != 0 ||
+		    !S_ISDIR(dir_stat.st_mode) || now - dir_stat.st_mtime < 2) {
+			to_search.push_back(i);
+			continue;
+		}
+		mtimes[i] = dir_stat.st_mtime;
+		auto it = cache.find(path);
+		if (it == cache.end() || it->second.mtime != mtimes[i]) {
+			to_search.push_back(i);
+			continue;
+		}
+		for (auto& name : it->second.names)
+			listings[i].emplace_back(name, path + DIRSEP + name);
+		new_cache[path] = move(it->second);
+		++stats.from_cache;
+	}
+	search_paths_for_dicts(paths, to_search, listings, 8);
+	auto changed = false;
+	for (auto i : to_search) {
+		if (mtimes[i] == -1)
+			continue;
+		auto& dir = new_cache[paths[i]];
+		dir.mtime = mtimes[i];
+		for (auto& [name, full_path] : listings[i])
+			dir.names.push_back(name);
+		changed = true;
+	}
+	changed |= new_cache.size() != cache.size();
+	stats.cache_written = changed && write_dir_cache(cache_file, new_cache);
+
+	merge_listings(listings, dictionaries);
+	stats.directories = paths.size();
+	stats.search_time = chrono::steady_clock::now() - start;
+#else
+	(void)cache_file;
+	search_for_dictionaries();
+#endif
+}
+
+/**
+ * @brief Gets the default path of the cache file of search_for_dictionaries().
+ *
+ * It is nuspell/dictionaries in $XDG_CACHE_HOME or in ~/.cache.
+ *
+ * @return the path, or empty string if there is no suitable directory
+ */
+auto Finder::default_cache_path() -> std::string
+{
+#ifdef _POSIX_VERSION
+	auto xdg = getenv("XDG_CACHE_HOME");
+	if (xdg && xdg[0] == '/')
+		return xdg + string("/nuspell/dictionaries");
+	auto home = getenv("HOME");
+	if (home && home[0] == '/')
+		return home + string("/.cache/nuspell/dictionaries");
+#endif
+	return {};
 }
 
 /**
@@ -648,12 +891,28 @@ auto Finder::search_for_dictionaries() -> void
  */
 auto Finder::search_all_dirs_for_dicts() -> Finder
 {
+	return search_all_dirs_for_dicts(string());
+}
+
+/**
+ * @brief Creates Finder object with all possible dictionaries found, using a
+ * cache of the directory listings.
+ * @param cache_file path of the cache file, e.g. default_cache_path(), empty
+ * for no cache
+ * @return Finder object
+ * @see search_for_dictionaries(const std::string&)
+ */
+auto Finder::search_all_dirs_for_dicts(const std::string& cache_file)
+    -> Finder
+{
+	auto start = chrono::steady_clock::now();
 	auto ret = Finder();
 	ret.add_default_dir_paths();
 	ret.add_mozilla_dir_paths();
 	ret.add_libreoffice_dir_paths();
 	ret.add_openoffice_dir_paths();
-	ret.search_for_dictionaries();
+	ret.stats.paths_time = chrono::steady_clock::now() - start;
+	ret.search_for_dictionaries(cache_file);
 	return ret;
 }
 
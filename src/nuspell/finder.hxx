@@ -23,17 +23,33 @@
 
 #ifndef NUSPELL_FINDER_HXX
 #define NUSPELL_FINDER_HXX
+#include <chrono>
 #include <string>
 #include <utility>
 #include <vector>
 
 namespace nuspell {
-inline namespace v3 {
+inline namespace v4 {
+
+/**
+ * @brief Statistics about the last search for dictionaries.
+ */
+struct Finder_Stats {
+	size_t directories = 0; /**< number of searched directories */
+	size_t from_cache = 0;  /**< directories whose listing was cached */
+	bool cache_written = false;
+	/** time for finding the directory paths */
+	std::chrono::nanoseconds paths_time = {};
+	/** time for searching the directories */
+	std::chrono::nanoseconds search_time = {};
+};
+
 class Finder {
 	using Dict_List = std::vector<std::pair<std::string, std::string>>;
 
 	std::vector<std::string> paths;
 	Dict_List dictionaries;
+	Finder_Stats stats;
 
       public:
 	using const_iterator = Dict_List::const_iterator;
@@ -43,11 +59,16 @@ class Finder {
 	auto add_libreoffice_dir_paths() -> void;
 	auto add_openoffice_dir_paths() -> void;
 	auto search_for_dictionaries() -> void;
+	auto search_for_dictionaries(const std::string& cache_file) -> void;
 
 	auto static search_all_dirs_for_dicts() -> Finder;
+	auto static search_all_dirs_for_dicts(const std::string& cache_file)
+	    -> Finder;
+	auto static default_cache_path() -> std::string;
 
 	auto& get_dir_paths() const { return paths; }
 	auto& get_dictionaries() const { return dictionaries; }
+	auto& get_stats() const { return stats; }
 	auto begin() const { return dictionaries.begin(); }
 	auto end() const { return dictionaries.end(); }
 	auto find(const std::string& dict) const -> const_iterator;
@@ -55,7 +76,7 @@ class Finder {
 	    -> std::pair<const_iterator, const_iterator>;
 	auto get_dictionary_path(const std::string& dict) const -> std::string;
 };
-} // namespace v3
+} // namespace v4
 } // namespace nuspell
 
 #endif // NUSPELL_FINDER_HXX
@@ -18,14 +18,28 @@
 
 #include "dictionary.hxx"
 #include "finder.hxx"
+#include "registry.hxx"
+#include "server.hxx"
 #include "utils.hxx"
 
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include <boost/locale.hpp>
 
+#include <unicode/brkiter.h>
+#include <unicode/utext.h>
+
 // manually define if not supplied by the build system
 #ifndef PROJECT_VERSION
 #define PROJECT_VERSION "unknown.version"
@@ -38,6 +52,12 @@
 #include <unistd.h>
 #endif
 
+#ifdef _POSIX_MAPPED_FILES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 using namespace std;
 using namespace nuspell;
 
@@ -55,12 +75,21 @@ enum Mode {
 	LIST_DICTIONARIES_MODE /**< printing available dictionaries */,
 	HELP_MODE /**< printing help information */,
 	VERSION_MODE /**< printing version information */,
+	SERVER_MODE /**< serving spell and suggest requests */,
 	ERROR_MODE
 };
 
+enum Output_Format {
+	ISPELL_FORMAT /**< Ispell-like text output */,
+	NDJSON_FORMAT /**< one JSON object per line for each checked word */
+};
+
 struct Args_t {
 	Mode mode = DEFAULT_MODE;
 	bool unicode_segmentation = false;
+	bool unique_words = false;
+	bool word_counts = false;
+	Output_Format format = ISPELL_FORMAT;
 	string program_name = "nuspell";
 	string dictionary;
 	string encoding;
@@ -88,10 +117,12 @@ auto Args_t::parse_args(int argc, char* argv[]) -> void
 	int c;
 	// The program can run in various modes depending on the
 	// command line options. mode is FSM state, this while loop is FSM.
-	const char* shortopts = ":d:i:aDGLSlhv";
+	const char* shortopts = ":d:i:aDGJLSclhuv";
 	const struct option longopts[] = {
 	    {"version", 0, nullptr, 'v'},
 	    {"help", 0, nullptr, 'h'},
+	    {"ndjson", 0, nullptr, 'J'},
+	    {"server", 0, nullptr, 's'},
 	    {nullptr, 0, nullptr, 0},
 	};
 	while ((c = getopt_long(argc, argv, shortopts, longopts, nullptr)) !=
@@ -105,10 +136,6 @@ auto Args_t::parse_args(int argc, char* argv[]) -> void
 		case 'd':
 			if (dictionary.empty())
 				dictionary = optarg;
-			else
-				cerr << "WARNING: Detected not yet supported "
-				        "other dictionary "
-				     << optarg << '\n';
 			other_dicts.emplace_back(optarg);
 
 			break;
@@ -155,6 +182,18 @@ auto Args_t::parse_args(int argc, char* argv[]) -> void
 		case 'S':
 			unicode_segmentation = true;
 
+			break;
+		case 'u':
+			unique_words = true;
+
+			break;
+		case 'c':
+			word_counts = true;
+
+			break;
+		case 'J':
+			format = NDJSON_FORMAT;
+
 			break;
 		case 'h':
 			if (mode == DEFAULT_MODE)
@@ -169,6 +208,13 @@ auto Args_t::parse_args(int argc, char* argv[]) -> void
 			else
 				mode = ERROR_MODE;
 
+			break;
+		case 's':
+			if (mode == DEFAULT_MODE)
+				mode = SERVER_MODE;
+			else
+				mode = ERROR_MODE;
+
 			break;
 		case ':':
 			cerr << "Option -" << static_cast<char>(optopt)
@@ -190,69 +236,67 @@ auto Args_t::parse_args(int argc, char* argv[]) -> void
 		// we will make it error here
 		mode = ERROR_MODE;
 	}
+	if (word_counts) {
+		unique_words = true;
+		if (mode != MISSPELLED_WORDS_MODE &&
+		    mode != CORRECT_WORDS_MODE)
+			mode = ERROR_MODE;
+	}
+	if (unique_words && unicode_segmentation)
+		mode = ERROR_MODE;
+	if (mode == SERVER_MODE &&
+	    (unicode_segmentation || unique_words || format != ISPELL_FORMAT ||
+	     !files.empty()))
+		mode = ERROR_MODE;
+	// The offsets would be ambiguous with several files.
+	if (format == NDJSON_FORMAT &&
+	    (mode == MISSPELLED_LINES_MODE || mode == CORRECT_LINES_MODE ||
+	     word_counts || files.size() > 1))
+		mode = ERROR_MODE;
 #endif
 }
 
-class My_Dictionary : public Dictionary {
-	Hash_Multiset<string> personal;
-
-      public:
-	auto& operator=(const Dictionary& d)
-	{
-		static_cast<Dictionary&>(*this) = d;
-		return *this;
-	}
-	auto& operator=(Dictionary&& d)
-	{
-		static_cast<Dictionary&>(*this) = move(d);
-		return *this;
-	}
-	auto spell(const string& word) const
-	{
-		auto correct = Dictionary::spell(word);
-		if (correct)
-			return true;
-		auto r = personal.equal_range(word);
-		correct = r.first != r.second;
-		return correct;
-	}
-	auto parse_personal_dict(istream& in, const locale& external_locale)
-	{
-		auto word = string();
-		auto wide_word = wstring();
-		while (getline(in, word)) {
-			auto ok = utf8_to_wide(word, wide_word);
-			ok &= to_narrow(wide_word, word, external_locale);
-			if (!ok)
-				continue;
-			personal.insert(word);
-		}
-		return in.eof();
-	}
-	auto parse_personal_dict(std::string name,
-	                         const locale& external_locale)
-	{
+/**
+ * @brief Loads the personal dictionary of the user into a dictionary.
+ *
+ * It is the file .nuspell_ followed by the dictionary name in the home
+ * directory, with one UTF-8 word per line. The lines are taken literally, a
+ * slash in them is not read as the start of a model word. Call before
+ * imbuing the dictionary.
+ */
+auto load_personal_dict(std::string name, Dictionary& dic)
+{
 #ifdef _WIN32
-		auto const PATH_SEPS = "\\/";
+	auto const PATH_SEPS = "\\/";
 #else
-		auto const PATH_SEPS = '/';
+	auto const PATH_SEPS = '/';
 #endif
-		auto file = ifstream();
-		auto path_sep_idx = name.find_last_of(PATH_SEPS);
-		if (path_sep_idx != name.npos)
-			name.erase(0, path_sep_idx + 1);
-		name.insert(0, ".nuspell_");
-		auto home = getenv("HOME");
-		if (home) {
-			name.insert(0, "/");
-			name.insert(0, home);
-		}
-		file.open(name);
-		if (file.is_open())
-			return parse_personal_dict(file, external_locale);
+	auto file = ifstream();
+	auto path_sep_idx = name.find_last_of(PATH_SEPS);
+	if (path_sep_idx != name.npos)
+		name.erase(0, path_sep_idx + 1);
+	name.insert(0, ".nuspell_");
+	auto home = getenv("HOME");
+	if (home) {
+		name.insert(0, "/");
+		name.insert(0, home);
+	}
+	file.open(name);
+	if (!file.is_open())
 		return true;
+	// escape the slashes to load all words at once
+	auto escaped = stringstream();
+	auto line = string();
+	while (getline(file, line)) {
+		for (auto c : line) {
+			if (c == '/')
+				escaped << '\\';
+			escaped << c;
+		}
+		escaped << '\n';
 	}
-};
+	return file.eof() && dic.load_personal_dictionary(escaped);
+}
 
 /**
  * @brief Prints help information to standard output.
@@ -265,15 +309,21 @@ auto print_help(const string& program_name) -> void
 	auto& o = cout;
 	o << "Usage:\n"
 	     "\n";
-	o << p << " [-S] [-d dict_NAME] [-i enc] [file_name]...\n";
-	o << p << " -l|-G [-L] [-S] [-d dict_NAME] [-i enc] [file_name]...\n";
+	o << p << " [-S|-u] [-d dict_NAME] [-i enc] [file_name]...\n";
+	o << p
+	  << " -l|-G [-L] [-S|-u] [-d dict_NAME] [-i enc] [file_name]...\n";
+	o << p << " -l|-G -c [-d dict_NAME] [-i enc] [file_name]...\n";
+	o << p << " -J [-l|-G] [-S|-u] [-d dict_NAME] [-i enc] [file_name]\n";
+	o << p << " --server [-d dict_NAME]...\n";
 	o << p << " -D|-h|--help|-v|--version\n";
 	o << "\n"
 	     "Check spelling of each FILE. Without FILE, check standard "
 	     "input.\n"
 	     "\n"
-	     "  -d di_CT      use di_CT dictionary. Only one dictionary at a\n"
-	     "                time is currently supported\n"
+	     "  -d di_CT      use di_CT dictionary. Can be given multiple "
+	     "times,\n"
+	     "                then a word is correct if any dictionary accepts "
+	     "it\n"
 	     "  -D            print search paths and available dictionaries\n"
 	     "                and exit\n"
 	     "  -i enc        input/output encoding, default is active locale\n"
@@ -281,6 +331,16 @@ auto print_help(const string& program_name) -> void
 	     "  -G            print only correct words or lines\n"
 	     "  -L            lines mode\n"
 	     "  -S            use Unicode text segmentation to extract words\n"
+	     "  -u            check each distinct word only once, in parallel\n"
+	     "  -c            print each distinct word once with its count,\n"
+	     "                most frequent first\n"
+	     "  -J, --ndjson  print a JSON object per line for each word,\n"
+	     "                with its byte offset, length, correctness\n"
+	     "                and suggestions\n"
+	     "  --server      serve spell and suggest requests from standard\n"
+	     "                input, see the manual for the protocol. The\n"
+	     "                dictionaries given with -d are loaded at start,\n"
+	     "                others on first use.\n"
 	     "  -h, --help    print this help and exit\n"
 	     "  -v, --version print version number and exit\n"
 	     "\n";
@@ -341,25 +401,161 @@ auto list_dictionaries(const Finder& f) -> void
 	}
 }
 
-auto process_word(
-    Mode mode, const My_Dictionary& dic, const string& line, streampos pos_line,
-    string::const_iterator b, string::const_iterator c, bool tellg_supported,
-    string& word,
-    vector<pair<string::const_iterator, string::const_iterator>>& wrong_words,
-    vector<string>& suggestions, ostream& out)
+/**
+ * @brief Output buffer that writes to a stream in large blocks.
+ *
+ * Used by the file mode so that the output does not go through the stream
+ * machinery for every word.
+ */
+class Buffered_Writer {
+	ostream& out;
+	string buf;
+	size_t capacity;
+
+      public:
+	explicit Buffered_Writer(ostream& out, size_t capacity = 1 << 20)
+	    : out(out), capacity(capacity)
+	{
+		buf.reserve(capacity);
+	}
+	Buffered_Writer(const Buffered_Writer&) = delete;
+	auto operator=(const Buffered_Writer&) -> Buffered_Writer& = delete;
+	~Buffered_Writer() { flush(); }
+	auto& operator<<(string_view s)
+	{
+		buf += s;
+		if (buf.size() >= capacity)
+			flush();
+		return *this;
+	}
+	auto& operator<<(char c)
+	{
+		buf += c;
+		if (buf.size() >= capacity)
+			flush();
+		return *this;
+	}
+	auto& operator<<(size_t n)
+	{
+		char str[20];
+		auto last = to_chars(begin(str), end(str), n).ptr;
+		return *this << string_view(str, last - str);
+	}
+	auto flush() -> void
+	{
+		out.write(buf.data(), buf.size());
+		buf.clear();
+	}
+};
+
+/**
+ * @brief Writes a JSON string literal, escaping the necessary characters.
+ */
+template <class Out>
+auto write_json_string(string_view s, Out& out)
+{
+	auto needs_escape = [](unsigned char c) {
+		return c < 0x20 || c == '"' || c == '\\';
+	};
+	out << '"';
+	for (auto a = begin(s);;) {
+		auto b = find_if(a, end(s), needs_escape);
+		out << s.substr(a - begin(s), b - a);
+		if (b == end(s))
+			break;
+		switch (*b) {
+		case '"':
+			out << "\\\"";
+			break;
+		case '\\':
+			out << "\\\\";
+			break;
+		case '\n':
+			out << "\\n";
+			break;
+		case '\t':
+			out << "\\t";
+			break;
+		case '\r':
+			out << "\\r";
+			break;
+		default:
+			auto hex = "0123456789abcdef";
+			out << "\\u00" << hex[*b >> 4] << hex[*b & 15];
+			break;
+		}
+		a = b + 1;
+	}
+	out << '"';
+}
+
+/**
+ * @brief Writes the NDJSON record of one word.
+ *
+ * The record holds the byte offset of the word in the input, its length in
+ * bytes, whether it is correct and, in the default mode, the suggestions for
+ * a misspelled word. In the other modes only the misspelled or only the
+ * correct words are written. JSON is always UTF-8, so the suggestions are
+ * converted from the encoding of the locale.
+ */
+template <class Dict, class Out, class Pos>
+auto write_ndjson_record(Mode mode, const Dict& dic, const locale& loc,
+                         Pos pos_word, string_view word, bool correct,
+                         string& word_buf, vector<string>& suggestions,
+                         Out& out)
+{
+	if ((mode == MISSPELLED_WORDS_MODE && correct) ||
+	    (mode == CORRECT_WORDS_MODE && !correct))
+		return;
+	out << "{\"offset\":" << pos_word << ",\"length\":" << word.size()
+	    << ",\"correct\":" << (correct ? "true" : "false");
+	if (mode == DEFAULT_MODE && !correct) {
+		word_buf.assign(word);
+		dic.suggest(word_buf, suggestions);
+		auto utf8 = is_locale_known_utf8(loc);
+		auto wide_sug = wstring();
+		out << ",\"suggestions\":[";
+		for (auto& sug : suggestions) {
+			if (&sug != &suggestions[0])
+				out << ',';
+			if (utf8) {
+				write_json_string(sug, out);
+				continue;
+			}
+			to_wide(sug, loc, wide_sug);
+			wide_to_utf8(wide_sug, word_buf);
+			write_json_string(word_buf, out);
+		}
+		out << ']';
+	}
+	out << "}\n";
+}
+
+template <class Dict, class Out, class Pos>
+auto process_word(Mode mode, Output_Format format, const Dict& dic,
+                  const locale& loc, string_view line, Pos pos_line,
+                  string_view word, bool tellg_supported, string& word_buf,
+                  vector<string_view>& wrong_words,
+                  vector<string>& suggestions, Out& out)
 {
-	word.assign(b, c);
 	auto correct = dic.spell(word);
+	if (format == NDJSON_FORMAT) {
+		auto pos_word = pos_line + (word.data() - line.data());
+		write_ndjson_record(mode, dic, loc, pos_word, word, correct,
+		                    word_buf, suggestions, out);
+		return;
+	}
 	switch (mode) {
 	case DEFAULT_MODE: {
 		if (correct) {
 			out << "*\n";
 			break;
 		}
-		dic.suggest(word, suggestions);
-		auto pos_word = pos_line;
+		word_buf.assign(word);
+		dic.suggest(word_buf, suggestions);
+		auto pos_word = Pos(0);
 		if (tellg_supported)
-			pos_word += b - begin(line);
+			pos_word = pos_line + (word.data() - line.data());
 		if (suggestions.empty()) {
 			out << "# " << word << ' ' << pos_word << '\n';
 			break;
@@ -383,18 +579,16 @@ auto process_word(
 	case MISSPELLED_LINES_MODE:
 	case CORRECT_LINES_MODE:
 		if (!correct)
-			wrong_words.emplace_back(b, c);
+			wrong_words.push_back(word);
 		break;
 	default:
 		break;
 	}
 }
 
-auto process_line(
-    Mode mode, const string& line,
-    const vector<pair<string::const_iterator, string::const_iterator>>&
-        wrong_words,
-    ostream& out)
+template <class Out>
+auto process_line(Mode mode, string_view line,
+                  const vector<string_view>& wrong_words, Out& out)
 {
 	switch (mode) {
 	case MISSPELLED_LINES_MODE:
@@ -410,86 +604,481 @@ auto process_line(
 	}
 }
 
-auto whitespace_segmentation_loop(istream& in, ostream& out,
-                                  const My_Dictionary& dic, Mode mode)
-{
-	auto line = string();
-	auto word = string();
-	auto suggestions = vector<string>();
-	using Str_Iter = string::const_iterator;
-	auto wrong_words = vector<pair<Str_Iter, Str_Iter>>();
-	auto loc = in.getloc();
-	auto pos_line = in.tellg();
-	auto tellg_supported = true;
-	if (pos_line < 0) {
-		pos_line = 0;
-		tellg_supported = false;
+#ifdef _POSIX_MAPPED_FILES
+/**
+ * @brief Read-only memory mapping of a whole regular file.
+ */
+class Mapped_File {
+	void* ptr = MAP_FAILED;
+	size_t sz = 0;
+
+      public:
+	Mapped_File() = default;
+	Mapped_File(const Mapped_File&) = delete;
+	auto operator=(const Mapped_File&) -> Mapped_File& = delete;
+	~Mapped_File()
+	{
+		if (ptr != MAP_FAILED)
+			munmap(ptr, sz);
 	}
-	auto line_num = size_t(0);
-	auto& facet = use_facet<ctype<char>>(loc);
-	auto isspace = [&](char c) { return facet.is(facet.space, c); };
-	while (getline(in, line)) {
-		++line_num;
-		wrong_words.clear();
+
+	/**
+	 * @brief Maps the file.
+	 * @return false if the file can not be opened or it is not a regular
+	 * file, e.g. a pipe, in which case it should be read as a stream.
+	 */
+	auto open(const string& file_name) -> bool
+	{
+		auto fd = ::open(file_name.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		auto ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+		if (ok && st.st_size != 0) {
+			sz = st.st_size;
+			ptr = mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+			ok = ptr != MAP_FAILED;
+			if (ok)
+				posix_madvise(ptr, sz, POSIX_MADV_SEQUENTIAL);
+		}
+		close(fd);
+		return ok;
+	}
+	auto view() const -> string_view
+	{
+		if (ptr == MAP_FAILED)
+			return {};
+		return {static_cast<const char*>(ptr), sz};
+	}
+};
+#endif
+
+/**
+ * @brief Whitespace classification of all byte values for a given locale.
+ *
+ * Used instead of calling the ctype facet for every byte of a large input.
+ * Line breaks always separate words.
+ */
+class Is_Space {
+	array<bool, 256> table;
+
+      public:
+	explicit Is_Space(const locale& loc)
+	{
+		auto& facet = use_facet<ctype<char>>(loc);
+		for (size_t i = 0; i != size(table); ++i)
+			table[i] = facet.is(facet.space, char(i));
+		table['\n'] = true;
+	}
+	auto operator()(char c) const
+	{
+		return table[static_cast<unsigned char>(c)];
+	}
+};
+
+/**
+ * @brief Splits lines into words at whitespace.
+ */
+class Whitespace_Segmenter {
+	Is_Space isspace;
+
+      public:
+	explicit Whitespace_Segmenter(const locale& loc) : isspace(loc) {}
+	template <class F>
+	auto operator()(string_view line, F f) const
+	{
 		for (auto a = begin(line); a != end(line);) {
 			auto b = find_if_not(a, end(line), isspace);
 			if (b == end(line))
 				break;
 			auto c = find_if(b, end(line), isspace);
+			f(line.substr(b - begin(line), c - b));
+			a = c;
+		}
+	}
+};
 
-			process_word(mode, dic, line, pos_line, b, c,
-			             tellg_supported, word, wrong_words,
-			             suggestions, out);
+/**
+ * @brief Splits UTF-8 lines into words with the ICU word break iterator.
+ *
+ * The break iterator is created once and reused for all lines. The lines are
+ * accessed in place through UText, without conversion to UTF-16. Only the
+ * segments that contain letters or numbers are words.
+ */
+class ICU_Word_Segmenter {
+	unique_ptr<icu::BreakIterator> iter;
+	UText text = UTEXT_INITIALIZER;
 
-			a = c;
+      public:
+	explicit ICU_Word_Segmenter(const locale& loc)
+	{
+		auto& info = use_facet<boost::locale::info>(loc);
+		auto icu_loc = icu::Locale(info.language().c_str(),
+		                           info.country().c_str());
+		auto err = U_ZERO_ERROR;
+		iter.reset(
+		    icu::BreakIterator::createWordInstance(icu_loc, err));
+		if (U_FAILURE(err))
+			iter.reset();
+	}
+	ICU_Word_Segmenter(const ICU_Word_Segmenter&) = delete;
+	auto operator=(const ICU_Word_Segmenter&)
+	    -> ICU_Word_Segmenter& = delete;
+	~ICU_Word_Segmenter() { utext_close(&text); }
+	auto valid() const { return iter != nullptr; }
+	template <class F>
+	auto operator()(string_view line, F f)
+	{
+		auto err = U_ZERO_ERROR;
+		utext_openUTF8(&text, line.data(), line.size(), &err);
+		iter->setText(&text, err);
+		if (U_FAILURE(err))
+			return;
+		auto a = iter->first();
+		for (auto b = iter->next(); b != icu::BreakIterator::DONE;
+		     a = b, b = iter->next()) {
+			if (iter->getRuleStatus() >= UBRK_WORD_NONE_LIMIT)
+				f(line.substr(a, b - a));
 		}
-		process_line(mode, line, wrong_words, out);
+	}
+};
 
-		if (tellg_supported)
-			pos_line = in.tellg();
+/**
+ * @brief Splits lines into words with the Boost.Locale boundary analysis.
+ *
+ * Used for input in encodings other than UTF-8.
+ */
+class Boost_Word_Segmenter {
+	boost::locale::boundary::csegment_index index;
+	locale loc;
+
+      public:
+	explicit Boost_Word_Segmenter(const locale& loc) : loc(loc)
+	{
+		index.rule(boost::locale::boundary::word_any);
 	}
-}
+	template <class F>
+	auto operator()(string_view line, F f)
+	{
+		auto first = line.data();
+		index.map(boost::locale::boundary::word, first,
+		          first + line.size(), loc);
+		for (auto& segment : index) {
+			auto offset = begin(segment) - first;
+			f(line.substr(offset, segment.length()));
+		}
+	}
+};
 
-auto unicode_segentation_loop(istream& in, ostream& out,
-                              const My_Dictionary& dic, Mode mode)
+/**
+ * @brief Checks the words of an input stream, line by line.
+ */
+template <class Segmenter>
+auto segmentation_loop(istream& in, ostream& out, const Dictionary_Set& dic,
+                       const locale& loc, Mode mode, Output_Format format,
+                       Segmenter& segment)
 {
-	namespace b = boost::locale::boundary;
 	auto line = string();
 	auto word = string();
 	auto suggestions = vector<string>();
-	using Str_Iter = string::const_iterator;
-	auto wrong_words = vector<pair<Str_Iter, Str_Iter>>();
-	auto loc = in.getloc();
+	auto wrong_words = vector<string_view>();
 	auto pos_line = in.tellg();
 	auto tellg_supported = true;
 	if (pos_line < 0) {
 		pos_line = 0;
 		tellg_supported = false;
 	}
-	auto line_num = size_t(0);
-	auto index = b::ssegment_index();
-	index.rule(b::word_any);
-	auto line_stream = istringstream();
 	while (getline(in, line)) {
-		++line_num;
-		index.map(b::word, begin(line), end(line), loc);
 		wrong_words.clear();
-		auto a = cbegin(line);
-		for (auto& segment : index) {
-			auto b = begin(segment);
-			auto c = end(segment);
+		segment(line, [&](string_view word_view) {
+			process_word(mode, format, dic, loc, line, pos_line,
+			             word_view, tellg_supported, word,
+			             wrong_words, suggestions, out);
+		});
+		process_line(mode, line, wrong_words, out);
+
+		if (tellg_supported)
+			pos_line = in.tellg();
+		else
+			pos_line += streamoff(line.size() + !in.eof());
+	}
+}
 
-			process_word(mode, dic, line, pos_line, b, c,
-			             tellg_supported, word, wrong_words,
+/**
+ * @brief Checks the words of a whole file in memory.
+ *
+ * Produces the same output as segmentation_loop(), but the words are views
+ * into the text and the output is written in large blocks.
+ */
+template <class Dict, class Segmenter>
+auto segmentation_text(string_view text, ostream& out_stream, const Dict& dic,
+                       const locale& loc, Mode mode, Output_Format format,
+                       Segmenter& segment)
+{
+	auto out = Buffered_Writer(out_stream);
+	auto word = string();
+	auto suggestions = vector<string>();
+	auto wrong_words = vector<string_view>();
+	for (size_t pos_line = 0; pos_line != text.size();) {
+		auto eol = text.find('\n', pos_line);
+		if (eol == text.npos)
+			eol = text.size();
+		auto line = text.substr(pos_line, eol - pos_line);
+		wrong_words.clear();
+		segment(line, [&](string_view word_view) {
+			process_word(mode, format, dic, loc, line, pos_line,
+			             word_view, true, word, wrong_words,
 			             suggestions, out);
+		});
+		process_line(mode, line, wrong_words, out);
 
-			a = c;
+		pos_line = min(eol + 1, text.size());
+	}
+}
+
+template <class F>
+auto run_in_threads(size_t n_threads, F f)
+{
+	auto threads = vector<thread>();
+	for (size_t i = 1; i < n_threads; ++i)
+		threads.emplace_back(f, i);
+	f(size_t(0));
+	for (auto& t : threads)
+		t.join();
+}
+
+/**
+ * @brief Distinct words of the input, each checked only once.
+ *
+ * The spelling results can be read back through spell() and suggest() with
+ * the same signature as in the dictionary, so the output of each occurrence
+ * can be reconstructed in order by the usual output functions.
+ */
+class Checked_Words {
+	struct Result {
+		size_t count = 0;
+		bool correct = false;
+		vector<string> suggestions;
+	};
+	unordered_map<string_view, Result> results;
+
+      public:
+	auto count(const vector<string_view>& texts,
+	           const Whitespace_Segmenter& segment, size_t n_threads)
+	    -> void;
+	auto check(const Dictionary_Set& dic, Mode mode, size_t n_threads)
+	    -> void;
+	auto size() const { return results.size(); }
+	auto spell(string_view word) const
+	{
+		return results.find(word)->second.correct;
+	}
+	auto suggest(string_view word, vector<string>& out) const
+	{
+		out = results.find(word)->second.suggestions;
+	}
+	auto print_counts(ostream& out, Mode mode) const -> void;
+};
+
+/**
+ * @brief Counts the occurrences of each word.
+ *
+ * The texts are split into chunks at line breaks, each thread counts the
+ * words of its chunks into its own table and the tables are merged at the
+ * end. The counted words are views into the texts.
+ */
+auto Checked_Words::count(const vector<string_view>& texts,
+                          const Whitespace_Segmenter& segment,
+                          size_t n_threads) -> void
+{
+	auto constexpr CHUNK_SIZE = size_t(1) << 20;
+	auto chunks = vector<string_view>();
+	for (auto text : texts) {
+		while (!text.empty()) {
+			auto n = text.find('\n', CHUNK_SIZE);
+			n = n == text.npos ? text.size() : n + 1;
+			chunks.push_back(text.substr(0, n));
+			text.remove_prefix(n);
 		}
-		process_line(mode, line, wrong_words, out);
+	}
+	auto next_chunk = atomic<size_t>(0);
+	auto partial = vector<unordered_map<string_view, size_t>>(n_threads);
+	run_in_threads(n_threads, [&](size_t thread_idx) {
+		auto& counts = partial[thread_idx];
+		for (size_t i; (i = next_chunk++) < chunks.size();)
+			segment(chunks[i], [&](string_view w) { ++counts[w]; });
+	});
+	for (auto& counts : partial)
+		for (auto& [word, n] : counts)
+			results[word].count += n;
+}
 
-		if (tellg_supported)
-			pos_line = in.tellg();
+/**
+ * @brief Spells each counted word, and in the default mode suggests for the
+ * misspelled ones, distributing the words among the threads.
+ */
+auto Checked_Words::check(const Dictionary_Set& dic, Mode mode,
+                          size_t n_threads) -> void
+{
+	auto words = vector<decltype(results)::value_type*>();
+	words.reserve(results.size());
+	for (auto& r : results)
+		words.push_back(&r);
+	auto constexpr BLOCK_SIZE = size_t(16);
+	auto next_block = atomic<size_t>(0);
+	run_in_threads(n_threads, [&](size_t) {
+		auto word = string();
+		for (size_t i;
+		     (i = next_block.fetch_add(BLOCK_SIZE)) < words.size();) {
+			auto last = min(i + BLOCK_SIZE, words.size());
+			for (; i != last; ++i) {
+				auto& [word_view, r] = *words[i];
+				r.correct = dic.spell(word_view);
+				if (r.correct || mode != DEFAULT_MODE)
+					continue;
+				word.assign(word_view);
+				dic.suggest(word, r.suggestions);
+			}
+		}
+	});
+}
+
+/**
+ * @brief Prints the misspelled or the correct words, depending on the mode,
+ * with their counts, most frequent first.
+ */
+auto Checked_Words::print_counts(ostream& out_stream, Mode mode) const -> void
+{
+	auto want_correct = mode == CORRECT_WORDS_MODE;
+	auto words = vector<const decltype(results)::value_type*>();
+	for (auto& r : results)
+		if (r.second.correct == want_correct)
+			words.push_back(&r);
+	sort(begin(words), end(words), [](auto a, auto b) {
+		if (a->second.count != b->second.count)
+			return a->second.count > b->second.count;
+		return a->first < b->first;
+	});
+	auto out = Buffered_Writer(out_stream);
+	for (auto r : words)
+		out << r->second.count << ' ' << r->first << '\n';
+}
+
+/**
+ * @brief Checks all the input with each distinct word checked only once.
+ *
+ * All of the input is held in memory, files are memory-mapped if possible.
+ *
+ * @return exit status of the program
+ */
+auto unique_words_mode(const Args_t& args, const Dictionary_Set& dic,
+                       const locale& loc) -> int
+{
+	auto buffers = list<string>();
+#ifdef _POSIX_MAPPED_FILES
+	auto mappings = list<Mapped_File>();
+#endif
+	auto texts = vector<string_view>();
+	auto read_all = [&](istream& in) {
+		auto& buf = buffers.emplace_back(istreambuf_iterator<char>(in),
+		                                 istreambuf_iterator<char>());
+		texts.push_back(buf);
+	};
+	if (args.files.empty())
+		read_all(cin);
+	for (auto& file_name : args.files) {
+#ifdef _POSIX_MAPPED_FILES
+		auto& mapped = mappings.emplace_back();
+		if (mapped.open(file_name)) {
+			texts.push_back(mapped.view());
+			continue;
+		}
+		mappings.pop_back();
+#endif
+		ifstream in(file_name);
+		if (!in.is_open()) {
+			cerr << "Can't open " << file_name << '\n';
+			return 1;
+		}
+		read_all(in);
 	}
+
+	auto start = chrono::steady_clock::now();
+	auto n_threads = max(thread::hardware_concurrency(), 1u);
+	auto segment = Whitespace_Segmenter(loc);
+	auto words = Checked_Words();
+	words.count(texts, segment, n_threads);
+	words.check(dic, args.mode, n_threads);
+	if (args.word_counts) {
+		words.print_counts(cout, args.mode);
+	}
+	else {
+		for (auto text : texts)
+			segmentation_text(text, cout, words, loc, args.mode,
+			                  args.format, segment);
+	}
+	cout.flush();
+	auto duration =
+	    chrono::duration<double>(chrono::steady_clock::now() - start);
+	auto mb = 0.0;
+	for (auto text : texts)
+		mb += text.size() / 1e6;
+	clog << "INFO: Checked " << mb << " MB with " << words.size()
+	     << " distinct words in " << duration.count() << " s, "
+	     << mb / duration.count() << " MB/s\n";
+	return 0;
+}
+
+/**
+ * @brief Checks standard input or the files given on the command line.
+ *
+ * Regular files are memory-mapped if possible, otherwise they are read as
+ * streams.
+ *
+ * @return exit status of the program
+ */
+template <class Segmenter>
+auto check_input(const Args_t& args, const Dictionary_Set& dic,
+                 const locale& loc, Segmenter& segmenter) -> int
+{
+	if (args.files.empty()) {
+		segmentation_loop(cin, cout, dic, loc, args.mode, args.format,
+		                  segmenter);
+		return 0;
+	}
+	auto bytes = size_t(0);
+	auto start = chrono::steady_clock::now();
+	for (auto& file_name : args.files) {
+#ifdef _POSIX_MAPPED_FILES
+		auto mapped = Mapped_File();
+		if (mapped.open(file_name)) {
+			auto text = mapped.view();
+			segmentation_text(text, cout, dic, loc, args.mode,
+			                  args.format, segmenter);
+			bytes += text.size();
+			continue;
+		}
+#endif
+		ifstream in(file_name);
+		if (!in.is_open()) {
+			cerr << "Can't open " << file_name << '\n';
+			return 1;
+		}
+		in.imbue(loc);
+		segmentation_loop(in, cout, dic, loc, args.mode, args.format,
+		                  segmenter);
+		in.clear();
+		auto end_pos = in.tellg();
+		if (end_pos > 0)
+			bytes += end_pos;
+	}
+	cout.flush();
+	auto duration =
+	    chrono::duration<double>(chrono::steady_clock::now() - start);
+	auto mb = bytes / 1e6;
+	clog << "INFO: Checked " << mb << " MB in " << duration.count()
+	     << " s, " << mb / duration.count() << " MB/s\n";
+	return 0;
 }
 
 namespace std {
@@ -549,12 +1138,42 @@ int main(int argc, char* argv[])
 	}
 	clog << "INFO: I/O  locale " << loc << '\n';
 
-	auto f = Finder::search_all_dirs_for_dicts();
+	auto cache_path = string();
+	auto no_cache = getenv("NUSPELL_NO_CACHE");
+	if (!no_cache || no_cache[0] == '\0')
+		cache_path = Finder::default_cache_path();
+	auto f = Finder::search_all_dirs_for_dicts(cache_path);
+	{
+		auto& st = f.get_stats();
+		auto ms = [](auto d) {
+			return chrono::duration<double, milli>(d).count();
+		};
+		clog << "INFO: Found dictionary directories in "
+		     << ms(st.paths_time) << " ms, searched "
+		     << st.directories << " of them (" << st.from_cache
+		     << " cached) in " << ms(st.search_time) << " ms\n";
+	}
 
 	if (args.mode == LIST_DICTIONARIES_MODE) {
 		list_dictionaries(f);
 		return 0;
 	}
+	if (args.mode == SERVER_MODE) {
+		auto dics = Dictionary_Registry(move(f));
+		for (auto& name : args.other_dicts) {
+			try {
+				dics.get(name);
+			}
+			catch (const Dictionary_Loading_Error& e) {
+				cerr << e.what() << '\n';
+				return 1;
+			}
+			clog << "INFO: Loaded dictionary " << name << '\n';
+		}
+		auto n_threads = max(thread::hardware_concurrency(), 1u);
+		serve(cin, cout, dics, n_threads);
+		return 0;
+	}
 	if (args.dictionary.empty()) {
 		// infer dictionary from locale
 		auto& info = use_facet<boost::locale::info>(loc);
@@ -569,38 +1188,39 @@ int main(int argc, char* argv[])
 		cerr << "No dictionary provided and can not infer from OS "
 		        "locale\n";
 	}
-	auto filename = f.get_dictionary_path(args.dictionary);
-	if (filename.empty()) {
-		cerr << "Dictionary " << args.dictionary << " not found\n";
-		return 1;
-	}
-	clog << "INFO: Pointed dictionary " << filename << ".{dic,aff}\n";
-	auto dic = My_Dictionary();
-	try {
-		dic = Dictionary::load_from_path(filename);
-		dic.parse_personal_dict(args.dictionary, loc);
-	}
-	catch (const Dictionary_Loading_Error& e) {
-		cerr << e.what() << '\n';
-		return 1;
+	if (args.other_dicts.empty())
+		args.other_dicts.push_back(args.dictionary);
+	auto dic = Dictionary_Set();
+	for (auto& name : args.other_dicts) {
+		auto filename = f.get_dictionary_path(name);
+		if (filename.empty()) {
+			cerr << "Dictionary " << name << " not found\n";
+			return 1;
+		}
+		clog << "INFO: Pointed dictionary " << filename
+		     << ".{dic,aff}\n";
+		try {
+			auto d = Dictionary::load_from_path(filename);
+			load_personal_dict(name, d);
+			dic.add(move(d));
+		}
+		catch (const Dictionary_Loading_Error& e) {
+			cerr << e.what() << '\n';
+			return 1;
+		}
 	}
 	dic.imbue(loc);
-	auto loop_function = whitespace_segmentation_loop;
-	if (args.unicode_segmentation)
-		loop_function = unicode_segentation_loop;
-	if (args.files.empty()) {
-		loop_function(cin, cout, dic, args.mode);
+	if (args.unique_words)
+		return unique_words_mode(args, dic, loc);
+	if (!args.unicode_segmentation) {
+		auto segmenter = Whitespace_Segmenter(loc);
+		return check_input(args, dic, loc, segmenter);
 	}
-	else {
-		for (auto& file_name : args.files) {
-			ifstream in(file_name);
-			if (!in.is_open()) {
-				cerr << "Can't open " << file_name << '\n';
-				return 1;
-			}
-			in.imbue(loc);
-			loop_function(in, cout, dic, args.mode);
-		}
+	if (use_facet<boost::locale::info>(loc).utf8()) {
+		auto segmenter = ICU_Word_Segmenter(loc);
+		if (segmenter.valid())
+			return check_input(args, dic, loc, segmenter);
 	}
-	return 0;
+	auto segmenter = Boost_Word_Segmenter(loc);
+	return check_input(args, dic, loc, segmenter);
 }
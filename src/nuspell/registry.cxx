@@ -0,0 +1,214 @@
+/* Copyright 2016-2019 Dimitrij Mijoski
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "registry.hxx"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+
+namespace nuspell {
+inline namespace v4 {
+
+namespace {
+/**
+ * @brief Gets the size of the .aff and .dic files of a dictionary.
+ *
+ * It is used as the estimate of the memory the loaded dictionary takes.
+ */
+auto dictionary_files_size(const string& path) -> size_t
+{
+	auto size = size_t(0);
+	for (auto ext : {".aff", ".dic"}) {
+		auto f = ifstream(path + ext, ios_base::ate | ios_base::binary);
+		auto pos = f.tellg();
+		if (pos > 0)
+			size += size_t(pos);
+	}
+	return size;
+}
+} // namespace
+
+Dictionary_Registry::~Dictionary_Registry()
+{
+	for (auto& t : preloaders)
+		t.join();
+}
+
+/**
+ * @brief Gets the registry of the process.
+ *
+ * It is created on first use, with the dictionaries that
+ * Finder::search_all_dirs_for_dicts() finds.
+ */
+auto Dictionary_Registry::instance() -> Dictionary_Registry&
+{
+	static auto registry =
+	    Dictionary_Registry(Finder::search_all_dirs_for_dicts());
+	return registry;
+}
+
+/**
+ * @brief Gets a loaded dictionary, loading it if needed.
+ *
+ * If another thread is loading the same dictionary, waits for it instead of
+ * loading it again.
+ *
+ * @param dict name of the dictionary, or its path without the extension
+ * @return the shared dictionary
+ * @throws Dictionary_Loading_Error if the dictionary is not found or can
+ * not be loaded. The next request tries to load it again.
+ */
+auto Dictionary_Registry::get(const std::string& dict) -> Dic_Ptr
+{
+	auto path = finder.get_dictionary_path(dict);
+	if (path.empty())
+		throw Dictionary_Loading_Error("Dictionary " + dict +
+		                               " not found");
+	auto lock = unique_lock<mutex>(mtx);
+	auto [it, inserted] = entries.try_emplace(path);
+	it->second.last_request = ++requests;
+	if (!inserted) {
+		auto& e = it->second;
+		// Failed loads are erased before they are ready, so this is
+		// a dictionary, copied while the lock is held.
+		if (e.dic.wait_for(chrono::seconds(0)) == future_status::ready)
+			return e.dic.get();
+		// Waiters hold no Dic_Ptr yet, they keep it from eviction.
+		++e.waiters;
+		auto fut = e.dic;
+		lock.unlock();
+		auto dic = fut.get(); // on failure the entry is already gone
+		lock.lock();
+		--entries.at(path).waiters;
+		return dic;
+	}
+	auto promise = std::promise<Dic_Ptr>();
+	it->second.dic = promise.get_future().share();
+	lock.unlock();
+
+	auto dic = Dic_Ptr();
+	try {
+		dic = make_shared<const Dictionary>(
+		    Dictionary::load_from_path(path));
+	}
+	catch (...) {
+		// Erase first, trim_locked() must never see the exception.
+		lock.lock();
+		entries.erase(path);
+		lock.unlock();
+		promise.set_exception(current_exception());
+		throw;
+	}
+	auto size = dictionary_files_size(path);
+	promise.set_value(dic);
+	lock.lock();
+	// Entries that are still loading are never evicted, so it is there.
+	entries[path].size = size;
+	total_size += size;
+	trim_locked();
+	return dic;
+}
+
+/**
+ * @brief Loads dictionaries in a background thread.
+ *
+ * Dictionaries that are not found or fail to load are skipped. Preloaded
+ * dictionaries are subject to the memory budget like the others.
+ *
+ * @param dicts names or paths of the dictionaries
+ */
+auto Dictionary_Registry::preload(std::vector<std::string> dicts) -> void
+{
+	auto t = thread([this, dicts = move(dicts)]() {
+		for (auto& d : dicts) {
+			try {
+				get(d);
+			}
+			catch (const Dictionary_Loading_Error&) {
+			}
+		}
+	});
+	auto lock = lock_guard<mutex>(mtx);
+	preloaders.push_back(move(t));
+}
+
+/**
+ * @brief Sets the memory budget and evicts idle dictionaries above it.
+ *
+ * The memory of a dictionary is estimated with the size of its files, so the
+ * budget is compared to the total size of the .aff and .dic files of the
+ * loaded dictionaries. The default budget is unlimited.
+ *
+ * @param bytes the budget
+ */
+auto Dictionary_Registry::set_memory_budget(size_t bytes) -> void
+{
+	auto lock = lock_guard<mutex>(mtx);
+	budget = bytes;
+	trim_locked();
+}
+
+/**
+ * @brief Gets the estimated memory of the loaded dictionaries.
+ * @see set_memory_budget()
+ */
+auto Dictionary_Registry::memory_usage() -> size_t
+{
+	auto lock = lock_guard<mutex>(mtx);
+	return total_size;
+}
+
+/**
+ * @brief Evicts idle dictionaries until the memory budget is met.
+ *
+ * This is done after each load. Call it after releasing dictionaries to
+ * free their memory earlier.
+ */
+auto Dictionary_Registry::trim() -> void
+{
+	auto lock = lock_guard<mutex>(mtx);
+	trim_locked();
+}
+
+auto Dictionary_Registry::trim_locked() -> void
+{
+	while (total_size > budget) {
+		auto victim = end(entries);
+		for (auto it = begin(entries); it != end(entries); ++it) {
+			auto& e = it->second;
+			if (e.dic.wait_for(chrono::seconds(0)) !=
+			    future_status::ready)
+				continue;
+			// Only the registry holds it, and nobody can get it
+			// while the lock is held, except the waiters.
+			if (e.waiters != 0 || e.dic.get().use_count() != 1)
+				continue;
+			if (victim == end(entries) ||
+			    e.last_request < victim->second.last_request)
+				victim = it;
+		}
+		if (victim == end(entries))
+			return;
+		total_size -= victim->second.size;
+		entries.erase(victim);
+	}
+}
+} // namespace v4
+} // namespace nuspell
@@ -0,0 +1,84 @@
+/* Copyright 2016-2019 Dimitrij Mijoski
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Sharing of loaded dictionaries, PUBLIC HEADER.
+ */
+
+#ifndef NUSPELL_REGISTRY_HXX
+#define NUSPELL_REGISTRY_HXX
+
+#include "dictionary.hxx"
+#include "finder.hxx"
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace nuspell {
+inline namespace v4 {
+
+/**
+ * @brief Registry of loaded dictionaries, shared by the whole process.
+ *
+ * Each dictionary is loaded at most once, even if it is requested from
+ * several threads at the same time, and all requests for it get the same
+ * instance. Dictionaries that are not used outside of the registry are
+ * evicted, least recently requested first, when the loaded dictionaries
+ * exceed the memory budget.
+ *
+ * All member functions are thread-safe.
+ */
+class Dictionary_Registry {
+	using Dic_Ptr = std::shared_ptr<const Dictionary>;
+	struct Entry {
+		std::shared_future<Dic_Ptr> dic;
+		size_t size = 0;
+		size_t last_request = 0;
+		size_t waiters = 0;
+	};
+	Finder finder;
+	std::mutex mtx;
+	std::unordered_map<std::string, Entry> entries;
+	size_t requests = 0;
+	size_t total_size = 0;
+	size_t budget = -1;
+	std::vector<std::thread> preloaders;
+
+	auto trim_locked() -> void;
+
+      public:
+	explicit Dictionary_Registry(Finder f = {}) : finder(std::move(f)) {}
+	Dictionary_Registry(const Dictionary_Registry&) = delete;
+	auto operator=(const Dictionary_Registry&) = delete;
+	~Dictionary_Registry();
+	auto static instance() -> Dictionary_Registry&;
+
+	auto get(const std::string& dict) -> Dic_Ptr;
+	auto preload(std::vector<std::string> dicts) -> void;
+	auto set_memory_budget(size_t bytes) -> void;
+	auto memory_usage() -> size_t;
+	auto trim() -> void;
+	auto& get_finder() const { return finder; }
+};
+} // namespace v4
+} // namespace nuspell
+#endif // NUSPELL_REGISTRY_HXX
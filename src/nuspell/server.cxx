@@ -0,0 +1,171 @@
+/* Copyright 2016-2019 Dimitrij Mijoski
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server.hxx"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+using namespace std;
+
+namespace nuspell {
+inline namespace v4 {
+
+/**
+ * @brief Handles one request of the server protocol.
+ *
+ * A request is a line with four tab separated fields: id, command, dictionary
+ * name and word. The commands are spell and suggest. The response is a line
+ * that starts with the id of the request and a tab. It is followed by "ok",
+ * then for spell "1" or "0", and for suggest the suggestions, all separated
+ * by tabs. On error "err" and a message follow the id. Other errors while
+ * loading the dictionary or checking, e.g. running out of memory, are
+ * reported as "internal error" instead of ending the worker thread.
+ *
+ * @param request the request line
+ * @param dics dictionaries of the server
+ * @param suggestions buffer for the suggestions
+ * @param[out] response the response line, including the line break
+ */
+auto handle_request(string_view request, Dictionary_Registry& dics,
+                    vector<string>& suggestions, string& response) -> void
+{
+	string_view fields[4];
+	auto n = size_t(0);
+	for (; n != size(fields); ++n) {
+		auto tab = request.find('\t');
+		fields[n] = request.substr(0, tab);
+		if (tab == request.npos) {
+			request = {};
+			++n;
+			break;
+		}
+		request.remove_prefix(tab + 1);
+	}
+	auto& [id, command, dic_name, word] = fields;
+	response.assign(id);
+	response += '\t';
+	if (n != size(fields) || !request.empty()) {
+		response += "err\tbad request\n";
+		return;
+	}
+	if (command != "spell" && command != "suggest") {
+		response += "err\tunknown command\n";
+		return;
+	}
+	auto prefix_size = response.size();
+	try {
+		auto dic = dics.get(string(dic_name));
+		if (command == "spell") {
+			response += dic->spell(word) ? "ok\t1\n" : "ok\t0\n";
+			return;
+		}
+		dic->suggest(string(word), suggestions);
+		response += "ok";
+		for (auto& sug : suggestions) {
+			response += '\t';
+			response += sug;
+		}
+		response += '\n';
+	}
+	catch (const Dictionary_Loading_Error&) {
+		response.resize(prefix_size);
+		response += "err\tunknown dictionary\n";
+	}
+	catch (const exception&) {
+		response.resize(prefix_size);
+		response += "err\tinternal error\n";
+	}
+}
+
+/**
+ * @brief Serves requests read from a stream until its end.
+ *
+ * The requests are handled concurrently by a pool of worker threads, so the
+ * responses may be written in a different order than the requests were
+ * read. Clients can send many requests without waiting for the responses and
+ * match the responses by the id. The output is flushed whenever there are no
+ * pending requests.
+ */
+auto serve(istream& in, ostream& out, Dictionary_Registry& dics,
+           size_t n_threads) -> void
+{
+	auto constexpr MAX_QUEUED = size_t(4096);
+	auto queue = deque<string>();
+	auto queue_mtx = mutex();
+	auto queue_not_empty = condition_variable();
+	auto queue_not_full = condition_variable();
+	auto end_of_input = false;
+	auto pending = atomic<size_t>(0);
+	auto out_mtx = mutex();
+
+	auto worker = [&](size_t) {
+		auto request = string();
+		auto response = string();
+		auto suggestions = vector<string>();
+		for (;;) {
+			{
+				auto lock = unique_lock<mutex>(queue_mtx);
+				queue_not_empty.wait(lock, [&]() {
+					return !queue.empty() || end_of_input;
+				});
+				if (queue.empty())
+					return;
+				request = move(queue.front());
+				queue.pop_front();
+			}
+			queue_not_full.notify_one();
+			handle_request(request, dics, suggestions, response);
+			auto lock = unique_lock<mutex>(out_mtx);
+			out << response;
+			if (--pending == 0)
+				out.flush();
+		}
+	};
+	// Reading from a tied stream flushes the output stream, which would
+	// race with the workers.
+	auto tied = in.tie(nullptr);
+	auto threads = vector<thread>();
+	for (size_t i = 0; i != n_threads; ++i)
+		threads.emplace_back(worker, i);
+	for (auto line = string(); getline(in, line);) {
+		auto lock = unique_lock<mutex>(queue_mtx);
+		queue_not_full.wait(
+		    lock, [&]() { return queue.size() < MAX_QUEUED; });
+		++pending;
+		queue.push_back(move(line));
+		lock.unlock();
+		queue_not_empty.notify_one();
+	}
+	{
+		auto lock = unique_lock<mutex>(queue_mtx);
+		end_of_input = true;
+	}
+	queue_not_empty.notify_all();
+	for (auto& t : threads)
+		t.join();
+	out.flush();
+	in.tie(tied);
+}
+} // namespace v4
+} // namespace nuspell
@@ -0,0 +1,46 @@
+/* Copyright 2016-2019 Dimitrij Mijoski
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Line based server protocol of the CLI, private header.
+ *
+ * Not installed, it is used only by the nuspell executable and the tests.
+ */
+
+#ifndef NUSPELL_SERVER_HXX
+#define NUSPELL_SERVER_HXX
+
+#include "registry.hxx"
+
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nuspell {
+inline namespace v4 {
+
+auto handle_request(std::string_view request, Dictionary_Registry& dics,
+                    std::vector<std::string>& suggestions,
+                    std::string& response) -> void;
+auto serve(std::istream& in, std::ostream& out, Dictionary_Registry& dics,
+           size_t n_threads) -> void;
+} // namespace v4
+} // namespace nuspell
+#endif // NUSPELL_SERVER_HXX
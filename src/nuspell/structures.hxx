@@ -32,14 +32,16 @@
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include <boost/container/small_vector.hpp>
+#include <boost/dynamic_bitset.hpp>
 #include <boost/range/iterator_range_core.hpp>
 
 namespace nuspell {
-inline namespace v3 {
+inline namespace v4 {
 #define NUSPELL_LITERAL(T, x) ::nuspell::literal_choose<T>(x, L##x)
 
 template <class CharT>
@@ -304,6 +306,14 @@ auto swap(String_Set<CharT>& a, String_Set<CharT>& b)
 
 using Flag_Set = String_Set<char16_t>;
 
+/**
+ * @brief Replaces substrings using a table of pairs, as in ICONV and OCONV.
+ *
+ * The string is scanned from left to right and at each position the longest
+ * matching key is replaced. The replaced text is not scanned again. The table
+ * is compiled into a trie, so one pass over the string is enough and strings
+ * without any character that starts a key are not touched at all.
+ */
 template <class CharT>
 class Substr_Replacer {
       public:
@@ -313,9 +323,31 @@ class Substr_Replacer {
 	using Table_Pairs = std::vector<Pair_Str>;
 
       private:
+	static constexpr auto npos = size_t(-1);
+	struct Node {
+		size_t first_edge; /**< children are in edges [first, last) */
+		size_t last_edge;
+		size_t match; /**< index in table, npos if no key ends here */
+	};
 	Table_Pairs table;
+	std::vector<Node> nodes;
+	std::vector<CharT> edge_labels; /**< sorted for each node */
+	std::vector<size_t> edge_targets;
+	boost::dynamic_bitset<> first_chars;
+
+	auto static char_index(CharT c) -> size_t
+	{
+		return size_t(std::char_traits<CharT>::to_int_type(c));
+	}
 	auto sort_uniq() -> void;
-	auto find_match(Str_View s) const;
+	auto compile() -> void;
+	auto may_start_key(CharT c) const
+	{
+		auto i = char_index(c);
+		return i < first_chars.size() && first_chars[i];
+	}
+	auto find_child(size_t node, CharT c) const -> size_t;
+	auto find_match(Str_View s) const -> std::pair<size_t, size_t>;
 
       public:
 	Substr_Replacer() = default;
@@ -355,74 +387,120 @@ auto Substr_Replacer<CharT>::sort_uniq() -> void
 	// remove empty key ""
 	if (!table.empty() && table.front().first.empty())
 		table.erase(begin(table));
+	compile();
 }
 
 template <class CharT>
-auto Substr_Replacer<CharT>::find_match(Str_View s) const
+auto Substr_Replacer<CharT>::compile() -> void
 {
-	auto& t = table;
-	struct Comparer_Str_Rep {
-		auto static cmp_prefix_of(const Str& p, Str_View of)
-		{
-			return p.compare(0, p.npos, of.data(),
-			                 std::min(p.size(), of.size()));
-		}
-		auto operator()(const Pair_Str& a, Str_View b)
-		{
-			return cmp_prefix_of(a.first, b) < 0;
-		}
-		auto operator()(Str_View a, const Pair_Str& b)
-		{
-			return cmp_prefix_of(b.first, a) > 0;
-		}
-		auto static eq(const Pair_Str& a, Str_View b)
-		{
-			return cmp_prefix_of(a.first, b) == 0;
-		}
-	};
-	Comparer_Str_Rep csr;
-	auto it = begin(t);
-	auto last_match = end(t);
-	for (;;) {
-		auto it2 = upper_bound(it, end(t), s, csr);
-		if (it2 == it) {
-			// not found, s is smaller that the range
-			break;
+	nodes.clear();
+	edge_labels.clear();
+	edge_targets.clear();
+	first_chars.clear();
+	if (table.empty())
+		return;
+
+	// Build a trie with a list of children per node. The keys are sorted,
+	// so the children get added in sorted order.
+	auto children = std::vector<std::vector<std::pair<CharT, size_t>>>(1);
+	auto matches = std::vector<size_t>{npos};
+	for (size_t i = 0; i != table.size(); ++i) {
+		size_t n = 0;
+		for (auto c : table[i].first) {
+			auto& ch = children[n];
+			if (!ch.empty() && ch.back().first == c) {
+				n = ch.back().second;
+				continue;
+			}
+			auto new_node = children.size();
+			ch.emplace_back(c, new_node);
+			children.emplace_back();
+			matches.push_back(npos);
+			n = new_node;
 		}
-		--it2;
-		if (csr.eq(*it2, s)) {
-			// Match found. Try another search maybe for
-			// longer.
-			last_match = it2;
-			it = ++it2;
+		matches[n] = i;
+	}
+
+	// Flatten it so the edges of each node are contiguous.
+	nodes.resize(children.size());
+	for (size_t n = 0; n != children.size(); ++n) {
+		nodes[n].first_edge = edge_labels.size();
+		for (auto& [c, target] : children[n]) {
+			edge_labels.push_back(c);
+			edge_targets.push_back(target);
 		}
-		else {
-			// not found, s is greater that the range
+		nodes[n].last_edge = edge_labels.size();
+		nodes[n].match = matches[n];
+	}
+
+	size_t max_first = 0;
+	for (auto& [c, target] : children[0])
+		max_first = std::max(max_first, char_index(c));
+	first_chars.resize(max_first + 1);
+	for (auto& [c, target] : children[0])
+		first_chars.set(char_index(c));
+}
+
+template <class CharT>
+auto Substr_Replacer<CharT>::find_child(size_t node, CharT c) const -> size_t
+{
+	auto first = begin(edge_labels) + nodes[node].first_edge;
+	auto last = begin(edge_labels) + nodes[node].last_edge;
+	auto it = std::lower_bound(first, last, c, [](CharT a, CharT b) {
+		return std::char_traits<CharT>::lt(a, b);
+	});
+	if (it == last || *it != c)
+		return npos;
+	return edge_targets[it - begin(edge_labels)];
+}
+
+/**
+ * @brief Finds the longest key that is a prefix of s.
+ * @return index of the key in the table and its length, npos if not found
+ */
+template <class CharT>
+auto Substr_Replacer<CharT>::find_match(Str_View s) const
+    -> std::pair<size_t, size_t>
+{
+	auto match = std::pair{npos, size_t(0)};
+	size_t n = 0;
+	for (size_t j = 0; j != s.size(); ++j) {
+		n = find_child(n, s[j]);
+		if (n == npos)
 			break;
-		}
+		if (nodes[n].match != npos)
+			match = {nodes[n].match, j + 1};
 	}
-	return last_match;
+	return match;
 }
 
 template <class CharT>
 auto Substr_Replacer<CharT>::replace(Str& s) const -> Str&
 {
-
 	if (table.empty())
 		return s;
-	for (size_t i = 0; i < s.size(); /*no increment here*/) {
-		auto substr = Str_View(&s[i], s.size() - i);
-		auto it = find_match(substr);
-		if (it != end(table)) {
-			auto& match = *it;
-			// match found. match.first is the found string,
-			// match.second is the replacement.
-			s.replace(i, match.first.size(), match.second);
-			i += match.second.size();
+	size_t i = 0;
+	while (i != s.size() && !may_start_key(s[i]))
+		++i;
+	if (i == s.size())
+		return s;
+
+	auto out = Str(s, 0, i);
+	while (i != s.size()) {
+		if (!may_start_key(s[i])) {
+			out += s[i++];
 			continue;
 		}
-		++i;
+		auto [idx, len] = find_match(Str_View(s).substr(i));
+		if (idx == npos) {
+			out += s[i++];
+			continue;
+		}
+		// match found, the replacement is not scanned again
+		out += table[idx].second;
+		i += len;
 	}
+	s = out;
 	return s;
 }
 
@@ -1419,11 +1497,31 @@ struct Compound_Pattern {
 	bool match_first_only_unaffixed_or_zero_affixed = false;
 };
 
+/**
+ * @brief Table of compound rules compiled into one automaton.
+ *
+ * All rules are compiled together into an automaton whose states are the
+ * positions in the rules, i.e. the next flag that should be matched in each
+ * rule, plus one accepting position at the end of each rule. A state of the
+ * matching is the set of active positions. It is advanced one word at a time
+ * with the flags of the word, so the matching can be done incrementally while
+ * the compound word is being split, and it becomes empty as soon as no rule
+ * can match the words so far.
+ */
 class Compound_Rule_Table {
+      public:
+	using State = boost::dynamic_bitset<>;
+
+      private:
 	std::vector<std::u16string> rules;
 	Flag_Set all_flags;
+	std::u16string position_flags;
+	std::vector<State> next_on_match;
+	State start_state;
+	State live_positions;
 
 	auto fill_all_flags() -> void;
+	auto compile() -> void;
 
       public:
 	Compound_Rule_Table() = default;
@@ -1452,6 +1550,19 @@ class Compound_Rule_Table {
 	auto has_any_of_flags(const Flag_Set& f) const -> bool;
 	auto match_any_rule(const std::vector<const Flag_Set*>& data) const
 	    -> bool;
+
+	auto initial_state() const -> const State& { return start_state; }
+	auto advance(const State& from, const Flag_Set& word_flags,
+	             State& to) const -> bool;
+	auto can_advance(const State& s) const
+	{
+		return s.intersects(live_positions);
+	}
+	auto is_accepting(const State& s) const
+	{
+		// has active position that is not live, i.e. accepting one
+		return !s.is_subset_of(live_positions);
+	}
 };
 auto inline Compound_Rule_Table::fill_all_flags() -> void
 {
@@ -1460,6 +1571,89 @@ auto inline Compound_Rule_Table::fill_all_flags() -> void
 	}
 	all_flags.erase(u'?');
 	all_flags.erase(u'*');
+	compile();
+}
+
+auto inline Compound_Rule_Table::compile() -> void
+{
+	// Each rule of length n items gets positions base + 0 to base + n.
+	// Position base + i means item i is the next to be matched, base + n
+	// is accepting. The node types are parsed like in match_simple_regex().
+	struct Item {
+		char16_t flag;
+		char16_t quantifier;
+	};
+	auto items = std::vector<Item>();
+	auto is_quantifier = [](char16_t c) { return c == '?' || c == '*'; };
+	for (auto& r : rules) {
+		for (size_t i = 0; i != r.size(); ++i) {
+			auto q = char16_t();
+			if (i + 1 != r.size() && is_quantifier(r[i + 1]))
+				q = r[i + 1];
+			items.push_back({r[i], q});
+			i += q != 0;
+		}
+		items.push_back({0, 0}); // accepting position
+	}
+	auto n = items.size();
+	position_flags.clear();
+	for (auto& it : items)
+		position_flags += it.flag;
+	live_positions.clear();
+	live_positions.resize(n);
+	for (size_t i = 0; i != n; ++i)
+		live_positions[i] = items[i].flag != 0;
+
+	// closure(i) is position i together with the positions reached by
+	// skipping items that can appear zero times.
+	auto closure = [&](size_t i) {
+		auto s = State(n);
+		for (;;) {
+			s.set(i);
+			if (items[i].flag == 0 || items[i].quantifier == 0)
+				break;
+			++i;
+		}
+		return s;
+	};
+	next_on_match.clear();
+	start_state.clear();
+	start_state.resize(n);
+	auto rule_start = true;
+	for (size_t i = 0; i != n; ++i) {
+		auto& it = items[i];
+		if (rule_start)
+			start_state |= closure(i);
+		rule_start = it.flag == 0;
+		if (it.flag == 0)
+			next_on_match.emplace_back(n);
+		else if (it.quantifier == '*')
+			next_on_match.push_back(closure(i));
+		else
+			next_on_match.push_back(closure(i + 1));
+	}
+}
+
+/**
+ * @brief Advances the state of matching with the flags of the next word.
+ * @param from current state
+ * @param word_flags flags of the next word of the compound
+ * @param[out] to resulting state
+ * @return false if no rule can match anymore, true otherwise
+ */
+auto inline Compound_Rule_Table::advance(const State& from,
+                                         const Flag_Set& word_flags,
+                                         State& to) const -> bool
+{
+	to.resize(position_flags.size());
+	to.reset();
+	for (auto i = from.find_first(); i != from.npos;
+	     i = from.find_next(i)) {
+		auto f = position_flags[i];
+		if (f != 0 && word_flags.contains(f))
+			to |= next_on_match[i];
+	}
+	return to.any();
 }
 
 auto inline Compound_Rule_Table::has_any_of_flags(const Flag_Set& f) const
@@ -1549,9 +1743,14 @@ auto inline match_compund_rule(const std::vector<const Flag_Set*>& words_data,
 auto inline Compound_Rule_Table::match_any_rule(
     const std::vector<const Flag_Set*>& data) const -> bool
 {
-	return any_of(begin(rules), end(rules), [&](const std::u16string& p) {
-		return match_compund_rule(data, p);
-	});
+	auto s = start_state;
+	auto tmp = State();
+	for (auto word_flags : data) {
+		if (!advance(s, *word_flags, tmp))
+			return false;
+		s.swap(tmp);
+	}
+	return is_accepting(s);
 }
 
 template <class CharT>
@@ -1996,21 +2195,160 @@ auto swap(List_Basic_Strings<CharT>& a, List_Basic_Strings<CharT>& b)
 using List_Strings = List_Basic_Strings<char>;
 using List_WStrings = List_Basic_Strings<wchar_t>;
 
+/**
+ * @brief Hash set of the strings of a List_Basic_Strings.
+ *
+ * Open addressing with linear probing, the slots store only indexes into the
+ * list. The set is bound to one list for its whole life. Strings appended to
+ * the list are added lazily on the next query, so the set stays in sync with
+ * a list that only grows with push_back(). Create a new set after any other
+ * modification of the list.
+ */
+template <class CharT>
+class List_Strings_Set {
+	using List = List_Basic_Strings<CharT>;
+	using Str_View = std::basic_string_view<CharT>;
+	static constexpr auto EMPTY = size_t(-1);
+
+	const List& list;
+	std::vector<size_t> slots;
+	size_t num_synced = 0;
+	size_t num_unique = 0;
+	unsigned long long lengths = 0; // bit i set if a string has length i
+
+	auto static length_bit(size_t len)
+	{
+		return 1ull << std::min(len, size_t(63));
+	}
+	auto find_slot(Str_View s) const -> size_t
+	{
+		auto mask = slots.size() - 1;
+		auto i = std::hash<Str_View>()(s) & mask;
+		while (slots[i] != EMPTY && list[slots[i]] != s)
+			i = (i + 1) & mask;
+		return i;
+	}
+	auto rehash(size_t count) -> void
+	{
+		slots.assign(count, EMPTY);
+		for (size_t j = 0; j != num_synced; ++j) {
+			auto i = find_slot(list[j]);
+			if (slots[i] == EMPTY)
+				slots[i] = j;
+		}
+	}
+	auto sync() -> void
+	{
+		for (; num_synced != list.size(); ++num_synced) {
+			if (2 * (num_unique + 1) > slots.size())
+				rehash(std::max(size_t(16), 2 * slots.size()));
+			auto& s = list[num_synced];
+			auto i = find_slot(s);
+			if (slots[i] != EMPTY)
+				continue;
+			slots[i] = num_synced;
+			++num_unique;
+			lengths |= length_bit(s.size());
+		}
+	}
+
+      public:
+	explicit List_Strings_Set(const List& l) : list(l) {}
+
+	/**
+	 * @brief Checks if the list contains a string.
+	 */
+	auto contains(Str_View s) -> bool
+	{
+		sync();
+		return !slots.empty() && slots[find_slot(s)] != EMPTY;
+	}
+
+	/**
+	 * @brief Checks if some string of the list is a substring of s.
+	 *
+	 * Only the substrings with lengths that the list has are looked up.
+	 */
+	auto contains_substring_of(Str_View s) -> bool
+	{
+		sync();
+		if (slots.empty())
+			return false;
+		for (size_t len = 0; len <= s.size(); ++len) {
+			if (!(lengths & length_bit(len)))
+				continue;
+			for (size_t i = 0; i + len <= s.size(); ++i)
+				if (slots[find_slot(s.substr(i, len))] != EMPTY)
+					return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Removes the repeated strings from a list, keeping the first
+	 * occurrence of each and the order.
+	 */
+	auto static remove_duplicates(List& l) -> void
+	{
+		auto set = List_Strings_Set(l);
+		auto out = size_t(0);
+		for (size_t j = 0; j != l.size(); ++j) {
+			if (2 * (set.num_unique + 1) > set.slots.size())
+				set.rehash(
+				    std::max(size_t(16), 2 * set.slots.size()));
+			auto i = set.find_slot(l[j]);
+			if (set.slots[i] != EMPTY)
+				continue;
+			if (out != j)
+				l[out] = std::move(l[j]);
+			set.slots[i] = out;
+			set.num_synced = ++out;
+			++set.num_unique;
+		}
+		l.erase(l.begin() + out, l.end());
+	}
+};
+using List_WStrings_Set = List_Strings_Set<wchar_t>;
+
+/**
+ * @brief Table of REP entries.
+ *
+ * Besides giving the entries grouped by their anchoring, all patterns are
+ * compiled into one Aho-Corasick automaton, so all matches in a word can be
+ * found in a single scan.
+ */
 template <class CharT>
 class Replacement_Table {
       public:
 	using Str = std::basic_string<CharT>;
+	using Str_View = std::basic_string_view<CharT>;
 	using Table_Str = std::vector<std::pair<Str, Str>>;
+	using value_type = typename Table_Str::value_type;
 	using iterator = typename Table_Str::iterator;
 	using const_iterator = typename Table_Str::const_iterator;
 
       private:
+	static constexpr auto npos = size_t(-1);
+	struct Node {
+		size_t first_edge; /**< children are in edges [first, last) */
+		size_t last_edge;
+		size_t fail;
+		size_t output_link; /**< next node on fail chain with outputs */
+		size_t first_output; /**< entries ending here are in outputs */
+		size_t last_output;
+	};
 	Table_Str table;
 	size_t whole_word_reps_last_idx = 0;
 	size_t start_word_reps_last_idx = 0;
 	size_t end_word_reps_last_idx = 0;
+	std::vector<Node> nodes;
+	std::vector<CharT> edge_labels; /**< sorted for each node */
+	std::vector<size_t> edge_targets;
+	std::vector<size_t> outputs; /**< indexes in table */
 
 	auto order_entries() -> void;
+	auto compile() -> void;
+	auto find_child(size_t node, CharT c) const -> size_t;
 
       public:
 	Replacement_Table() = default;
@@ -2053,6 +2391,21 @@ class Replacement_Table {
 	{
 		return {begin(table) + end_word_reps_last_idx, end(table)};
 	}
+
+	/**
+	 * @brief Finds all matches of all entries in a word, respecting the
+	 * anchoring of the entries.
+	 *
+	 * Overlapping matches are reported too. They are reported in order of
+	 * their end position, not in table order.
+	 *
+	 * @param word word to search in
+	 * @param f called as f(entry, pos) for every match, where entry is the
+	 * matched entry and pos is the position of the match in word. Should
+	 * return true to stop the search.
+	 */
+	template <class Func>
+	auto for_each_match(Str_View word, Func&& f) const -> void;
 };
 template <class CharT>
 auto Replacement_Table<CharT>::order_entries() -> void
@@ -2084,6 +2437,141 @@ auto Replacement_Table<CharT>::order_entries() -> void
 	end_word_reps_last_idx = end_word_reps_last - begin(table);
 	for_each(start_word_reps_last, end_word_reps_last,
 	         [](auto& e) { e.first.pop_back(); });
+	compile();
+}
+
+template <class CharT>
+auto Replacement_Table<CharT>::compile() -> void
+{
+	using namespace std;
+	auto lt = [](CharT a, CharT b) { return char_traits<CharT>::lt(a, b); };
+	auto children = vector<vector<pair<CharT, size_t>>>(1);
+	auto node_outputs = vector<vector<size_t>>(1);
+	for (size_t i = 0; i != table.size(); ++i) {
+		size_t n = 0;
+		for (auto c : table[i].first) {
+			auto& ch = children[n];
+			auto it = lower_bound(begin(ch), end(ch), c,
+			                      [&](auto& edge, CharT x) {
+				                      return lt(edge.first, x);
+			                      });
+			if (it != end(ch) && it->first == c) {
+				n = it->second;
+				continue;
+			}
+			auto new_node = children.size();
+			ch.emplace(it, c, new_node);
+			children.emplace_back();
+			node_outputs.emplace_back();
+			n = new_node;
+		}
+		if (n != 0)
+			node_outputs[n].push_back(i);
+	}
+
+	nodes.assign(children.size(), {});
+	edge_labels.clear();
+	edge_targets.clear();
+	outputs.clear();
+	for (size_t n = 0; n != children.size(); ++n) {
+		auto& node = nodes[n];
+		node.first_edge = edge_labels.size();
+		for (auto& [c, target] : children[n]) {
+			edge_labels.push_back(c);
+			edge_targets.push_back(target);
+		}
+		node.last_edge = edge_labels.size();
+		node.first_output = outputs.size();
+		outputs.insert(end(outputs), begin(node_outputs[n]),
+		               end(node_outputs[n]));
+		node.last_output = outputs.size();
+		node.output_link = npos;
+	}
+
+	// Breadth first, so the fail links of shorter nodes are ready.
+	auto queue = vector<size_t>{0};
+	for (size_t q = 0; q != queue.size(); ++q) {
+		auto u = queue[q];
+		for (auto& [c, v] : children[u]) {
+			queue.push_back(v);
+			auto f = npos;
+			if (u != 0) {
+				f = nodes[u].fail;
+				while (find_child(f, c) == npos && f != 0)
+					f = nodes[f].fail;
+				f = find_child(f, c);
+			}
+			if (f == npos)
+				f = 0;
+			auto& fail_node = nodes[f];
+			nodes[v].fail = f;
+			if (fail_node.first_output != fail_node.last_output)
+				nodes[v].output_link = f;
+			else
+				nodes[v].output_link = fail_node.output_link;
+		}
+	}
+}
+
+template <class CharT>
+auto Replacement_Table<CharT>::find_child(size_t node, CharT c) const
+    -> size_t
+{
+	auto first = begin(edge_labels) + nodes[node].first_edge;
+	auto last = begin(edge_labels) + nodes[node].last_edge;
+	auto it = std::lower_bound(first, last, c, [](CharT a, CharT b) {
+		return std::char_traits<CharT>::lt(a, b);
+	});
+	if (it == last || *it != c)
+		return npos;
+	return edge_targets[it - begin(edge_labels)];
+}
+
+template <class CharT>
+template <class Func>
+auto Replacement_Table<CharT>::for_each_match(Str_View word, Func&& f) const
+    -> void
+{
+	if (table.empty())
+		return;
+	size_t n = 0;
+	for (size_t j = 0; j != word.size(); ++j) {
+		auto c = word[j];
+		auto next = find_child(n, c);
+		while (next == npos && n != 0) {
+			n = nodes[n].fail;
+			next = find_child(n, c);
+		}
+		n = next == npos ? 0 : next;
+		auto m = n;
+		if (nodes[m].first_output == nodes[m].last_output)
+			m = nodes[m].output_link;
+		for (; m != npos; m = nodes[m].output_link) {
+			auto& node = nodes[m];
+			for (auto o = node.first_output; o != node.last_output;
+			     ++o) {
+				auto idx = outputs[o];
+				auto& entry = table[idx];
+				auto pos = j + 1 - entry.first.size();
+				auto at_begin = pos == 0;
+				auto at_end = j + 1 == word.size();
+				if (idx < whole_word_reps_last_idx) {
+					if (!at_begin || !at_end)
+						continue;
+				}
+				else if (idx < start_word_reps_last_idx) {
+					if (!at_begin)
+						continue;
+				}
+				else if (idx < end_word_reps_last_idx) {
+					if (!at_end)
+						continue;
+				}
+				if (f(entry, pos))
+					return;
+			}
+		}
+	}
 }
 
 template <class CharT>
@@ -2123,6 +2611,13 @@ auto Similarity_Group<CharT>::parse(const Str& s) -> void
 	}
 }
 
+/**
+ * @brief Table of PHONE rules.
+ *
+ * The patterns of the rules are parsed once, when the table is set. The
+ * rules are grouped by their first character, and for the characters below
+ * 256 the group is found directly by index.
+ */
 template <class CharT>
 class Phonetic_Table {
 	using Str = std::basic_string<CharT>;
@@ -2137,158 +2632,235 @@ class Phonetic_Table {
 		operator bool() { return count_matched; }
 	};
 
-	std::vector<std::pair<Str, Str>> table;
-	auto order() -> void;
-	auto static match(const Str& data, size_t i, const Str& pattern,
+	/**
+	 * @brief Parsed rule.
+	 *
+	 * The pattern is letters, optionally followed by a group of letters in
+	 * parentheses, one of which must come next, and then by the options
+	 * "<", "-", a digit for the priority, "^", "^" and "$", in that order.
+	 */
+	struct Rule {
+		CharT first = {}; /**< first character of the pattern */
+		Str letters;
+		Str group;
+		size_t go_back_before_replace = 0;
+		size_t priority = 5;
+		bool go_back_after_replace = false;
+		bool only_at_begin = false;
+		bool treat_next_as_begin = false;
+		bool only_at_end = false;
+		Str replacement;
+	};
+
+	std::vector<Rule> rules; /**< sorted by the first character */
+	/** rules[first_rule[c]] to rules[first_rule[c + 1]] begin with c */
+	std::vector<size_t> first_rule;
+
+	auto compile(std::vector<Pair_Str> table) -> void;
+	auto static parse(const Str& pattern, Rule& r) -> bool;
+	auto rules_for(CharT c) const -> std::pair<const Rule*, const Rule*>;
+	auto static match(const Str& data, size_t i, const Rule& r,
 	                  bool at_begin) -> Phonet_Match_Result;
+	auto apply(Str& word, bool drop_unmatched) const -> bool;
 
       public:
 	Phonetic_Table() = default;
-	Phonetic_Table(const std::vector<Pair_Str>& v) : table(v) { order(); }
-	Phonetic_Table(std::vector<Pair_Str>&& v) : table(move(v)) { order(); }
+	Phonetic_Table(const std::vector<Pair_Str>& v) { compile(v); }
+	Phonetic_Table(std::vector<Pair_Str>&& v) { compile(std::move(v)); }
 	auto& operator=(const std::vector<Pair_Str>& v)
 	{
-		table = v;
-		order();
+		compile(v);
 		return *this;
 	}
 	auto& operator=(std::vector<Pair_Str>&& v)
 	{
-		table = move(v);
-		order();
+		compile(std::move(v));
 		return *this;
 	}
-	auto replace(Str& word) const -> bool;
+	auto empty() const { return rules.empty(); }
+	auto replace(Str& word) const -> bool { return apply(word, false); }
+	auto code(Str& word) const -> void { apply(word, true); }
 };
 
 template <class CharT>
-auto Phonetic_Table<CharT>::order() -> void
+auto Phonetic_Table<CharT>::compile(std::vector<Pair_Str> table) -> void
 {
+	using U = std::make_unsigned_t<CharT>;
 	stable_sort(begin(table), end(table), [](auto& pair1, auto& pair2) {
 		if (pair2.first.empty())
 			return false;
 		if (pair1.first.empty())
 			return true;
-		return pair1.first[0] < pair2.first[0];
+		return U(pair1.first[0]) < U(pair2.first[0]);
 	});
-	auto it = find_if_not(begin(table), end(table),
-	                      [](auto& p) { return p.first.empty(); });
-	table.erase(begin(table), it);
-	for (auto& r : table) {
-		if (r.second == NUSPELL_LITERAL(CharT, "_"))
-			r.second.clear();
+	rules.clear();
+	for (auto& [pattern, replacement] : table) {
+		if (pattern.empty())
+			continue;
+		auto r = Rule();
+		// a rule that is not valid can never match
+		if (!parse(pattern, r))
+			continue;
+		r.first = pattern[0];
+		if (replacement != NUSPELL_LITERAL(CharT, "_"))
+			r.replacement = std::move(replacement);
+		rules.push_back(std::move(r));
+	}
+	first_rule.assign(257, 0);
+	auto it = begin(rules);
+	for (size_t c = 0; c != 256; ++c) {
+		first_rule[c] = it - begin(rules);
+		while (it != end(rules) && U(it->first) == c)
+			++it;
 	}
+	first_rule[256] = it - begin(rules);
 }
 
+/**
+ * @brief Parses the pattern of a rule.
+ *
+ * @return false if the rule is not valid
+ */
 template <class CharT>
-auto Phonetic_Table<CharT>::match(const Str& data, size_t i, const Str& pattern,
-                                  bool at_begin) -> Phonet_Match_Result
+auto Phonetic_Table<CharT>::parse(const Str& pattern, Rule& r) -> bool
 {
-	auto ret = Phonet_Match_Result();
 	auto j =
 	    pattern.find_first_of(NUSPELL_LITERAL(CharT, "(<-0123456789^$"));
 	if (j == pattern.npos)
 		j = pattern.size();
-	if (data.compare(i, j, pattern, 0, j) == 0)
-		ret.count_matched = j;
-	else
-		return {};
-	if (j == pattern.size())
-		return ret;
-	if (pattern[j] == '(') {
+	r.letters = pattern.substr(0, j);
+	auto count_matched = j;
+	if (j != pattern.size() && pattern[j] == '(') {
 		auto k = pattern.find(')', j);
-		if (k == pattern.npos)
-			return {}; // bad rule
-		auto x = std::char_traits<CharT>::find(
-		    &pattern[j + 1], k - (j + 1), data[i + j]);
-		if (!x)
-			return {};
+		if (k == pattern.npos || k == j + 1)
+			return false;
+		r.group = pattern.substr(j + 1, k - (j + 1));
 		j = k + 1;
-		ret.count_matched += 1;
+		count_matched += 1;
 	}
+	if (count_matched == 0)
+		return false;
 	if (j == pattern.size())
-		return ret;
+		return true;
 	if (pattern[j] == '<') {
-		ret.go_back_after_replace = true;
+		r.go_back_after_replace = true;
 		++j;
 	}
 	auto k = pattern.find_first_not_of('-', j);
-	if (k == pattern.npos) {
+	if (k == pattern.npos)
 		k = pattern.size();
-		ret.go_back_before_replace = k - j;
-		if (ret.go_back_before_replace >= ret.count_matched)
-			return {}; // bad rule
-		return ret;
-	}
-	else {
-		ret.go_back_before_replace = k - j;
-		if (ret.go_back_before_replace >= ret.count_matched)
-			return {}; // bad rule
-	}
+	r.go_back_before_replace = k - j;
+	if (r.go_back_before_replace >= count_matched)
+		return false;
+	if (k == pattern.size())
+		return true;
 	j = k;
 	if (pattern[j] >= '0' && pattern[j] <= '9') {
-		ret.priority = pattern[j] - '0';
+		r.priority = pattern[j] - '0';
 		++j;
 	}
 	if (j == pattern.size())
-		return ret;
+		return true;
 	if (pattern[j] == '^') {
-		if (!at_begin)
-			return {};
+		r.only_at_begin = true;
 		++j;
 	}
 	if (j == pattern.size())
-		return ret;
+		return true;
 	if (pattern[j] == '^') {
-		ret.treat_next_as_begin = true;
+		r.treat_next_as_begin = true;
 		++j;
 	}
 	if (j == pattern.size())
-		return ret;
+		return true;
 	if (pattern[j] != '$')
-		return {}; // bad rule, no other char is allowed at this point
-	if (i + ret.count_matched == data.size())
-		return ret;
-	return {};
+		return false; // no other char is allowed at this point
+	r.only_at_end = true;
+	return true;
 }
 
 template <class CharT>
-auto Phonetic_Table<CharT>::replace(Str& word) const -> bool
+auto Phonetic_Table<CharT>::rules_for(CharT c) const
+    -> std::pair<const Rule*, const Rule*>
 {
-	using boost::make_iterator_range;
-	struct Cmp {
-		auto operator()(CharT c, const Pair_Str& s)
-		{
-			return c < s.first[0];
-		}
-		auto operator()(const Pair_Str& s, CharT c)
-		{
-			return s.first[0] < c;
-		}
-	};
-	if (table.empty())
+	using U = std::make_unsigned_t<CharT>;
+	auto data = rules.data();
+	if (U(c) < 256)
+		return {data + first_rule[U(c)], data + first_rule[U(c) + 1]};
+	auto first = data + first_rule[256];
+	auto last = data + rules.size();
+	auto less = [](const Rule& r, CharT c) { return U(r.first) < U(c); };
+	first = std::lower_bound(first, last, c, less);
+	auto it = first;
+	while (it != last && it->first == c)
+		++it;
+	return {first, it};
+}
+
+template <class CharT>
+auto Phonetic_Table<CharT>::match(const Str& data, size_t i, const Rule& r,
+                                  bool at_begin) -> Phonet_Match_Result
+{
+	auto ret = Phonet_Match_Result();
+	auto n = r.letters.size();
+	if (data.compare(i, n, r.letters) != 0)
+		return {};
+	if (!r.group.empty()) {
+		if (i + n == data.size() ||
+		    r.group.find(data[i + n]) == Str::npos)
+			return {};
+		++n;
+	}
+	if (r.only_at_begin && !at_begin)
+		return {};
+	if (r.only_at_end && i + n != data.size())
+		return {};
+	ret.count_matched = n;
+	ret.go_back_before_replace = r.go_back_before_replace;
+	ret.priority = r.priority;
+	ret.go_back_after_replace = r.go_back_after_replace;
+	ret.treat_next_as_begin = r.treat_next_as_begin;
+	return ret;
+}
+
+/**
+ * @brief Applies the rules to a word in upper case.
+ *
+ * With replace() the characters that no rule matches are kept. With code()
+ * they are dropped, as in the phonetic codes of Aspell and Hunspell, where
+ * every kept letter has a rule, even if it gives the same letter.
+ *
+ * @param word the word, transformed in place
+ * @param drop_unmatched whether to drop the characters that no rule matches
+ * @return true if some rule was applied
+ */
+template <class CharT>
+auto Phonetic_Table<CharT>::apply(Str& word, bool drop_unmatched) const -> bool
+{
+	if (rules.empty()) {
+		if (drop_unmatched)
+			word.clear();
 		return false;
+	}
 	auto ret = false;
 	auto treat_next_as_begin = true;
 	size_t count_go_backs_after_replace = 0; // avoid infinite loop
 	for (size_t i = 0; i != word.size(); ++i) {
-		auto rules =
-		    equal_range(begin(table), end(table), word[i], Cmp());
-		for (auto& r : make_iterator_range(rules)) {
-			auto rule = &r;
-			auto m1 = match(word, i, r.first, treat_next_as_begin);
+		auto [first, last] = rules_for(word[i]);
+		auto matched = false;
+		for (auto r = first; r != last; ++r) {
+			auto rule = r;
+			auto m1 = match(word, i, *r, treat_next_as_begin);
 			if (!m1)
 				continue;
 			if (!m1.go_back_before_replace) {
 				auto j = i + m1.count_matched - 1;
-				auto rules2 = equal_range(
-				    begin(table), end(table), word[j], Cmp());
-				for (auto& r2 : make_iterator_range(rules2)) {
-					auto m2 =
-					    match(word, j, r2.first, false);
+				auto [first2, last2] = rules_for(word[j]);
+				for (auto r2 = first2; r2 != last2; ++r2) {
+					auto m2 = match(word, j, *r2, false);
 					if (m2 && m2.priority >= m1.priority) {
 						i = j;
-						rule = &r2;
+						rule = r2;
 						m1 = m2;
 						break;
 					}
@@ -2296,22 +2868,27 @@ auto Phonetic_Table<CharT>::replace(Str& word) const -> bool
 			}
 			word.replace(
 			    i, m1.count_matched - m1.go_back_before_replace,
-			    rule->second);
+			    rule->replacement);
 			treat_next_as_begin = m1.treat_next_as_begin;
 			if (m1.go_back_after_replace &&
 			    count_go_backs_after_replace < 100) {
 				count_go_backs_after_replace++;
 			}
 			else {
-				i += rule->second.size();
+				i += rule->replacement.size();
 			}
 			--i;
 			ret = true;
+			matched = true;
 			break;
 		}
+		if (!matched && drop_unmatched) {
+			word.erase(i, 1);
+			--i;
+		}
 	}
 	return ret;
 }
-} // namespace v3
+} // namespace v4
 } // namespace nuspell
 #endif // NUSPELL_STRUCTURES_HXX
@@ -47,9 +47,10 @@ using namespace std;
 
 enum class Utf_Error_Handling { ALWAYS_VALID, REPLACE, SKIP };
 
-template <Utf_Error_Handling eh, class InChar, class OutContainer>
-auto utf_to_utf(const std::basic_string<InChar>& in, OutContainer& out) -> bool
+template <Utf_Error_Handling eh, class InString, class OutContainer>
+auto utf_to_utf(const InString& in, OutContainer& out) -> bool
 {
+	using InChar = typename InString::value_type;
 	using OutChar = typename OutContainer::value_type;
 	using namespace boost::locale::utf;
 	using UEH = Utf_Error_Handling;
@@ -98,16 +99,14 @@ auto utf_to_utf(const std::basic_string<InChar>& in, OutContainer& out) -> bool
 	return valid;
 }
 
-template <class InChar, class OutContainer>
-auto valid_utf_to_utf(const std::basic_string<InChar>& in, OutContainer& out)
-    -> void
+template <class InString, class OutContainer>
+auto valid_utf_to_utf(const InString& in, OutContainer& out) -> void
 {
 	utf_to_utf<Utf_Error_Handling::ALWAYS_VALID>(in, out);
 }
 
-template <class InChar, class OutContainer>
-auto utf_to_utf_my(const std::basic_string<InChar>& in, OutContainer& out)
-    -> bool
+template <class InString, class OutContainer>
+auto utf_to_utf_my(const InString& in, OutContainer& out) -> bool
 {
 	return utf_to_utf<Utf_Error_Handling::REPLACE>(in, out);
 }
@@ -134,11 +133,11 @@ auto wide_to_utf8(const std::wstring& in) -> std::string
 	return out;
 }
 
-auto utf8_to_wide(const std::string& in, std::wstring& out) -> bool
+auto utf8_to_wide(std::string_view in, std::wstring& out) -> bool
 {
 	return utf_to_utf_my(in, out);
 }
-auto utf8_to_wide(const std::string& in) -> std::wstring
+auto utf8_to_wide(std::string_view in) -> std::wstring
 {
 	auto out = wstring();
 	utf_to_utf_my(in, out);
@@ -191,7 +190,7 @@ auto is_all_bmp(const std::u16string& s) -> bool
 	return none_of(begin(s), end(s), is_surrogate_pair);
 }
 
-auto to_wide(const std::string& in, const std::locale& loc, std::wstring& out)
+auto to_wide(std::string_view in, const std::locale& loc, std::wstring& out)
     -> bool
 {
 	auto& cvt = use_facet<codecvt<wchar_t, char, mbstate_t>>(loc);
@@ -237,7 +236,7 @@ auto to_wide(const std::string& in, const std::locale& loc, std::wstring& out)
 	return valid;
 }
 
-auto to_wide(const std::string& in, const std::locale& loc) -> std::wstring
+auto to_wide(std::string_view in, const std::locale& loc) -> std::wstring
 {
 	auto ret = wstring();
 	to_wide(in, loc, ret);
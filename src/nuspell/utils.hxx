@@ -43,8 +43,8 @@ namespace nuspell {
 auto wide_to_utf8(const std::wstring& in, std::string& out) -> void;
 auto wide_to_utf8(const std::wstring& in) -> std::string;
 
-auto utf8_to_wide(const std::string& in, std::wstring& out) -> bool;
-auto utf8_to_wide(const std::string& in) -> std::wstring;
+auto utf8_to_wide(std::string_view in, std::wstring& out) -> bool;
+auto utf8_to_wide(std::string_view in) -> std::wstring;
 
 auto utf8_to_16(const std::string& in) -> std::u16string;
 auto utf8_to_16(const std::string& in, std::u16string& out) -> bool;
@@ -57,9 +57,9 @@ auto latin1_to_ucs2(const std::string& s, std::u16string& out) -> void;
 
 auto is_all_bmp(const std::u16string& s) -> bool;
 
-auto to_wide(const std::string& in, const std::locale& inloc, std::wstring& out)
+auto to_wide(std::string_view in, const std::locale& inloc, std::wstring& out)
     -> bool;
-auto to_wide(const std::string& in, const std::locale& inloc) -> std::wstring;
+auto to_wide(std::string_view in, const std::locale& inloc) -> std::wstring;
 auto to_narrow(const std::wstring& in, std::string& out,
                const std::locale& outloc) -> bool;
 auto to_narrow(const std::wstring& in, const std::locale& outloc)
@@ -0,0 +1,407 @@
+/* Copyright 2020 Dimitrij Mijoski, Sander van Geloven
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nuspell/dictionary.hxx>
+#include <nuspell/finder.hxx>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include <boost/locale.hpp>
+
+// manually define if not supplied by the build system
+#ifndef PROJECT_VERSION
+#define PROJECT_VERSION "unknown.version"
+#endif
+#define PACKAGE_STRING "nuspell " PROJECT_VERSION
+
+#if defined(__MINGW32__) || defined(__unix__) || defined(__unix) ||            \
+    (defined(__APPLE__) && defined(__MACH__))
+#include <getopt.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace nuspell;
+
+enum Mode {
+	SPELL_MODE /**< measure spell() */,
+	SUGGEST_MODE /**< measure suggest() of the misspelled words */,
+	HELP_MODE /**< printing help information */,
+	VERSION_MODE /**< printing version information */,
+	ERROR_MODE /**< where the arguments used caused an error */
+};
+
+struct Args_t {
+	Mode mode = SPELL_MODE;
+	string program_name = "bench";
+	string dictionary;
+	string encoding;
+	size_t deletion_distance = 0;
+	bool word_form_dawg = false;
+	bool phonetic_index = false;
+	bool word_prefix_index = false;
+	vector<string> files;
+
+	Args_t() = default;
+	Args_t(int argc, char* argv[]) { parse_args(argc, argv); }
+	auto parse_args(int argc, char* argv[]) -> void;
+};
+
+auto Args_t::parse_args(int argc, char* argv[]) -> void
+{
+	if (argc != 0 && argv[0] && argv[0][0] != '\0')
+		program_name = argv[0];
+#if defined(_POSIX_VERSION) || defined(__MINGW32__)
+	int c;
+	const char* shortopts = ":ad:e:i:pswhv";
+	const struct option longopts[] = {
+	    {"version", 0, nullptr, 'v'},
+	    {"help", 0, nullptr, 'h'},
+	    {nullptr, 0, nullptr, 0},
+	};
+	while ((c = getopt_long(argc, argv, shortopts, longopts, nullptr)) !=
+	       -1) {
+		switch (c) {
+		case 'a':
+			word_form_dawg = true;
+
+			break;
+		case 'd':
+			dictionary = optarg;
+
+			break;
+		case 'e':
+			deletion_distance = strtoul(optarg, nullptr, 10);
+
+			break;
+		case 'i':
+			encoding = optarg;
+
+			break;
+		case 'p':
+			phonetic_index = true;
+
+			break;
+		case 's':
+			if (mode == SPELL_MODE)
+				mode = SUGGEST_MODE;
+			else
+				mode = ERROR_MODE;
+
+			break;
+		case 'w':
+			word_prefix_index = true;
+
+			break;
+		case 'h':
+			if (mode == SPELL_MODE)
+				mode = HELP_MODE;
+			else
+				mode = ERROR_MODE;
+
+			break;
+		case 'v':
+			if (mode == SPELL_MODE)
+				mode = VERSION_MODE;
+			else
+				mode = ERROR_MODE;
+
+			break;
+		case ':':
+			cerr << "Option -" << static_cast<char>(optopt)
+			     << " requires an operand\n";
+			mode = ERROR_MODE;
+
+			break;
+		case '?':
+			cerr << "Unrecognized option: '-"
+			     << static_cast<char>(optopt) << "'\n";
+			mode = ERROR_MODE;
+
+			break;
+		}
+	}
+	files.insert(files.end(), argv + optind, argv + argc);
+#endif
+}
+
+/**
+ * @brief Prints help information to standard output.
+ *
+ * @param program_name pass argv[0] here.
+ */
+auto print_help(const string& program_name) -> void
+{
+	auto& p = program_name;
+	auto& o = cout;
+	o << "Usage:\n"
+	     "\n";
+	o << p << " [-a] [-s] [-d dict_NAME] [-e dist] [-i enc] "
+	          "[file_name]...\n";
+	o << p << " -h|--help|-v|--version\n";
+	o << "\n"
+	     "Measure the latency of Nuspell for each word in FILE, one word "
+	     "per line.\n"
+	     "Without FILE, read standard input.\n"
+	     "\n"
+	     "  -a            use automaton of all simple word forms instead\n"
+	     "                of affix stripping\n"
+	     "  -d di_CT      use di_CT dictionary\n"
+	     "  -e dist       build deletion index for suggestions with edit\n"
+	     "                distance dist, usually 1 or 2\n"
+	     "  -i enc        input encoding, default is active locale\n"
+	     "  -p            build phonetic index for suggestions\n"
+	     "  -s            measure suggestions of the misspelled words\n"
+	     "                instead of spelling\n"
+	     "  -w            build word prefix index for suggestions\n"
+	     "  -h, --help    print this help and exit\n"
+	     "  -v, --version print version number and exit\n"
+	     "\n";
+	o << "Example: " << p << " -d de_DE long_compounds.txt\n";
+	o << "\n"
+	     "Statistics are printed to standard output, being:\n"
+	     "  Total Words\n"
+	     "  Measured Words\n"
+	     "  Total Duration\n"
+	     "  Average Duration\n"
+	     "  Max Duration\n"
+	     "  Slowest Word\n"
+	     "  Parts Checked (compound parts looked up in the dictionary)\n"
+	     "  Parts Pruned (compound parts skipped without a lookup)\n"
+	     "With -e, the cost of the deletion index is printed too, being:\n"
+	     "  Index Forms, Index Deletions, Index Memory (bytes), Index "
+	     "Build Time\n"
+	     "With -a, the expansion size is printed too, being:\n"
+	     "  Candidate Forms, Correct Forms, Automaton States, Automaton "
+	     "Edges,\n"
+	     "  Automaton Memory (bytes), Automaton Build Time\n"
+	     "For dictionaries with PHONE, the phonetic index is printed too, "
+	     "being:\n"
+	     "  Phonetic Roots, Phonetic Trigrams, Phonetic Memory (bytes),\n"
+	     "  Phonetic Build Time\n"
+	     "All durations are in nanoseconds and are highly machine and "
+	     "platform\n"
+	     "dependent. Use only executable from production build with "
+	     "optimizations.\n";
+}
+
+/**
+ * @brief Prints the version number to standard output.
+ */
+auto print_version() -> void
+{
+	cout << PACKAGE_STRING
+	    "\n"
+	    "Copyright (C) 2018-2020 Dimitrij Mijoski and Sander van Geloven\n"
+	    "License LGPLv3+: GNU LGPL version 3 or later "
+	    "<http://gnu.org/licenses/lgpl.html>.\n"
+	    "This is free software: you are free to change and "
+	    "redistribute it.\n"
+	    "There is NO WARRANTY, to the extent permitted by law.\n";
+}
+
+struct Bench_Stats {
+	size_t total = 0;
+	size_t measured = 0;
+	chrono::nanoseconds duration = {};
+	chrono::nanoseconds max_duration = {};
+	string slowest_word;
+	Compounding_Counters compounding;
+	Deletion_Index_Stats deletion_index;
+	Word_Form_Dawg_Stats word_form_dawg;
+	Phonetic_Index_Stats phonetic_index;
+
+	auto add(const string& word, chrono::nanoseconds d)
+	{
+		++measured;
+		duration += d;
+		if (d > max_duration) {
+			max_duration = d;
+			slowest_word = word;
+		}
+	}
+	auto print(ostream& out) const -> void;
+};
+
+auto Bench_Stats::print(ostream& out) const -> void
+{
+	out << "Total Words         " << total << '\n';
+	out << "Measured Words      " << measured << '\n';
+	if (measured == 0)
+		return;
+	out << "Total Duration      " << duration.count() << '\n';
+	out << "Average Duration    " << duration.count() / measured << '\n';
+	out << "Max Duration        " << max_duration.count() << '\n';
+	out << "Slowest Word        " << slowest_word << '\n';
+	out << "Parts Checked       " << compounding.parts_checked << '\n';
+	out << "Parts Pruned        " << compounding.parts_pruned << '\n';
+	if (word_form_dawg.built) {
+		auto& a = word_form_dawg;
+		out << "Candidate Forms     " << a.candidates << '\n';
+		out << "Correct Forms       " << a.forms << '\n';
+		out << "Automaton States    " << a.nodes << '\n';
+		out << "Automaton Edges     " << a.edges << '\n';
+		out << "Automaton Memory    " << a.memory << '\n';
+		out << "Automaton Build Time " << a.build_time.count() << '\n';
+	}
+	if (phonetic_index.built) {
+		auto& p = phonetic_index;
+		out << "Phonetic Roots      " << p.roots << '\n';
+		out << "Phonetic Trigrams   " << p.trigrams << '\n';
+		out << "Phonetic Memory     " << p.memory << '\n';
+		out << "Phonetic Build Time " << p.build_time.count() << '\n';
+	}
+	if (!deletion_index.built)
+		return;
+	auto& d = deletion_index;
+	out << "Index Forms         " << d.forms << '\n';
+	out << "Index Deletions     " << d.deletions << '\n';
+	out << "Index Memory        " << d.memory << '\n';
+	out << "Index Build Time    " << d.build_time.count() << '\n';
+}
+
+auto bench_loop(istream& in, const Dictionary& dic, Mode mode,
+                Bench_Stats& stats)
+{
+	using clock = chrono::high_resolution_clock;
+	auto word = string();
+	auto sugs = vector<string>();
+	while (getline(in, word)) {
+		++stats.total;
+		auto tick_a = clock::now();
+		auto correct = dic.spell(word);
+		auto tick_b = clock::now();
+		if (mode == SPELL_MODE) {
+			stats.add(word, tick_b - tick_a);
+			continue;
+		}
+		if (correct)
+			continue;
+		dic.suggest(word, sugs);
+		auto tick_c = clock::now();
+		stats.add(word, tick_c - tick_b);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	// May speed up I/O. After this, don't use C printf, scanf etc.
+	ios_base::sync_with_stdio(false);
+
+	auto args = Args_t(argc, argv);
+	if (args.mode == ERROR_MODE) {
+		cerr << "Invalid (combination of) arguments, try '"
+		     << args.program_name << " --help' for more information\n";
+		return 1;
+	}
+	boost::locale::generator gen;
+	auto loc = std::locale();
+	try {
+		if (args.encoding.empty())
+			loc = gen("");
+		else
+			loc = gen("en_US." + args.encoding);
+	}
+	catch (const boost::locale::conv::invalid_charset_error& e) {
+		cerr << e.what() << '\n';
+		return 1;
+	}
+	cin.imbue(loc);
+	cout.imbue(loc);
+
+	switch (args.mode) {
+	case HELP_MODE:
+		print_help(args.program_name);
+		return 0;
+	case VERSION_MODE:
+		print_version();
+		return 0;
+	default:
+		break;
+	}
+
+	auto f = Finder::search_all_dirs_for_dicts();
+	if (args.dictionary.empty()) {
+		// infer dictionary from locale
+		auto& info = use_facet<boost::locale::info>(loc);
+		args.dictionary = info.language();
+		auto c = info.country();
+		if (!c.empty()) {
+			args.dictionary += '_';
+			args.dictionary += c;
+		}
+	}
+	auto filename = f.get_dictionary_path(args.dictionary);
+	if (filename.empty()) {
+		cerr << "Dictionary " << args.dictionary << " not found\n";
+		return 1;
+	}
+	clog << "INFO: Pointed dictionary " << filename << ".{dic,aff}\n";
+	auto dic = Dictionary();
+	try {
+		dic = Dictionary::load_from_path(filename);
+	}
+	catch (const Dictionary_Loading_Error& e) {
+		cerr << e.what() << '\n';
+		return 1;
+	}
+	dic.imbue(loc);
+
+	auto stats = Bench_Stats();
+	if (args.word_prefix_index && !dic.build_word_prefix_index())
+		clog << "INFO: Word prefix index is not used with "
+		        "compounding\n";
+	if (args.phonetic_index) {
+		stats.phonetic_index = dic.build_phonetic_index();
+		if (!stats.phonetic_index.built)
+			clog << "INFO: The dictionary has no PHONE rules\n";
+	}
+	if (args.deletion_distance != 0) {
+		auto& d = stats.deletion_index;
+		d = dic.build_deletion_index(args.deletion_distance);
+		if (!d.built)
+			clog << "INFO: Deletion index can not be built for "
+			        "this dictionary\n";
+	}
+	if (args.word_form_dawg) {
+		stats.word_form_dawg = dic.build_word_form_dawg();
+		if (!stats.word_form_dawg.built)
+			clog << "INFO: Too many word forms for the automaton\n";
+	}
+	Dict_Base::compounding_counters() = {};
+	if (args.files.empty()) {
+		bench_loop(cin, dic, args.mode, stats);
+	}
+	else {
+		for (auto& file_name : args.files) {
+			ifstream in(file_name);
+			if (!in.is_open()) {
+				cerr << "Can't open " << file_name << '\n';
+				return 1;
+			}
+			in.imbue(loc);
+			bench_loop(in, dic, args.mode, stats);
+		}
+	}
+	stats.compounding = Dict_Base::compounding_counters();
+	stats.print(cout);
+	return 0;
+}
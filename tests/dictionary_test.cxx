@@ -18,6 +18,10 @@
 
 #include <nuspell/dictionary.hxx>
 
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
 #include <catch2/catch.hpp>
 
 using namespace std;
@@ -33,6 +37,179 @@ TEST_CASE("Dictionary::load_from_path", "[dictionary]")
 	CHECK_THROWS_AS(Dictionary::load_from_path(""),
 	                Dictionary_Loading_Error);
 }
+TEST_CASE("Dictionary::load_async", "[dictionary]")
+{
+	CHECK_THROWS_AS(Dictionary::load_async(""), Dictionary_Loading_Error);
+
+	auto path = string("load_async_test");
+	auto aff_text = string("SET UTF-8\nTRY abcdefghijklmnopqrstuvwxyz\n");
+	auto dic_text = string("5001\ntable\n");
+	for (auto i = 0; i != 5000; ++i)
+		dic_text += "word" + to_string(i) + '\n';
+	ofstream(path + ".aff") << aff_text;
+	ofstream(path + ".dic") << dic_text;
+
+	auto options = Load_Options();
+	options.word_prefix_index = true;
+	options.deletion_distance = 1;
+	auto f = Dictionary::load_async(path, options);
+	REQUIRE(f.valid());
+	CHECK(f.spell("table"));
+	CHECK(f.spell("word4999"));
+	CHECK_FALSE(f.spell("tabel"));
+	auto dic = f.get();
+	auto p = f.progress();
+	CHECK(p.stage == Load_Stage::READY);
+	CHECK(p.bytes_total == aff_text.size() + dic_text.size());
+	CHECK(p.bytes_parsed == p.bytes_total);
+	CHECK(p.words_inserted == 5001);
+	f = Dictionary_Future();
+	auto sugs = vector<string>();
+	dic->suggest("tabel", sugs);
+	CHECK(sugs == vector<string>{"table"});
+
+	ofstream(path + ".dic") << "no word count\n";
+	auto g = Dictionary::load_async(path);
+	CHECK_THROWS_AS(g.spell("table"), Dictionary_Loading_Error);
+	CHECK_THROWS_AS(g.get(), Dictionary_Loading_Error);
+	CHECK(g.progress().stage == Load_Stage::FAILED);
+
+	remove((path + ".aff").c_str());
+	remove((path + ".dic").c_str());
+}
+TEST_CASE("Dictionary::spell string_view", "[dictionary]")
+{
+	auto aff = istringstream("SET UTF-8\n");
+	auto dic = istringstream("2\ntable\nchair\n");
+	auto d = Dictionary::load_from_aff_dic(aff, dic);
+
+	// views into a larger buffer, not null terminated
+	auto text = string_view("table chairs chair");
+	CHECK(d.spell(text.substr(0, 5)) == true);
+	CHECK(d.spell(text.substr(6, 6)) == false);
+	CHECK(d.spell(text.substr(6, 5)) == true);
+	CHECK(d.spell(text.substr(13)) == true);
+	CHECK(d.spell(text) == false);
+	CHECK(d.spell(string("table")) == true);
+	CHECK(d.spell("chair") == true);
+	CHECK(d.spell("chairs") == false);
+}
+TEST_CASE("Dictionary_Set", "[dictionary]")
+{
+	auto aff_text = "SET UTF-8\nTRY abcdefghijklmnopqrstuvwxyz\n";
+	auto aff1 = istringstream(aff_text);
+	auto dic1 = istringstream("2\ntable\nchair\n");
+	auto aff2 = istringstream(aff_text);
+	auto dic2 = istringstream("2\ntisch\nstuhl\n");
+	auto set = Dictionary_Set();
+	CHECK(set.spell("table") == false);
+	set.add(Dictionary::load_from_aff_dic(aff1, dic1));
+	set.add(Dictionary::load_from_aff_dic(aff2, dic2));
+	REQUIRE(set.size() == 2);
+
+	for (auto& w : {"table", "chair", "tisch", "stuhl", "table"})
+		CHECK(set.spell(w) == true);
+	for (auto& w : {"tabel", "tish", "chairstuhl"})
+		CHECK(set.spell(w) == false);
+
+	auto sugs = vector<string>();
+	set.suggest("tabel", sugs);
+	CHECK(sugs == vector<string>{"table"});
+	set.suggest("tishc", sugs);
+	CHECK(sugs == vector<string>{"tisch"});
+}
+TEST_CASE("Dictionary personal words", "[dictionary]")
+{
+	auto aff = istringstream("SET UTF-8\n"
+	                         "TRY abcdefghijklmnopqrstuvwxyz\n"
+	                         "SFX S Y 1\n"
+	                         "SFX S 0 s .\n");
+	auto dic = istringstream("2\ntable/S\nchair\n");
+	auto d = Dictionary::load_from_aff_dic(aff, dic);
+	d.build_word_form_dawg();
+
+	CHECK(d.spell("nuspell") == false);
+	CHECK(d.add_word("nuspell") == true);
+	CHECK(d.spell("nuspell") == true);
+	CHECK(d.spell("Nuspell") == true);
+	CHECK(d.spell("nuspells") == false);
+	CHECK(d.spell("table") == true);
+
+	auto personal = istringstream("hunspell/table\nmyspell\n\n"
+	                              "aspell/nonexistent\r\n");
+	CHECK(d.load_personal_dictionary(personal) == true);
+	CHECK(d.spell("hunspell") == true);
+	CHECK(d.spell("hunspells") == true);
+	CHECK(d.spell("myspell") == true);
+	CHECK(d.spell("myspells") == false);
+	CHECK(d.spell("aspell") == true);
+	CHECK(d.spell("tables") == true);
+	CHECK(d.add_word("ispell", "nonexistent") == false);
+	CHECK(d.spell("ispell") == true);
+
+	// slashes in words are escaped in the file, literal in add_word()
+	personal = istringstream("TCP\\/IP\nLAN\\/WAN/table\n");
+	CHECK(d.load_personal_dictionary(personal) == true);
+	CHECK(d.spell("TCP/IP") == true);
+	CHECK(d.spell("TCP") == false);
+	CHECK(d.spell("LAN/WAN") == true);
+	CHECK(d.spell("LAN/WANs") == true);
+	CHECK(d.add_word("UDP/IP") == true);
+	CHECK(d.spell("UDP/IP") == true);
+	CHECK(d.spell("UDP") == false);
+
+	auto sugs = vector<string>();
+	d.suggest("hunspel", sugs);
+	REQUIRE(!sugs.empty());
+	CHECK(sugs[0] == "hunspell");
+}
+TEST_CASE("Dict_Base::add_personal_word updates the indexes", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.compound_flag = 'C';
+	d.words.emplace(L"foo", u"CS");
+	d.words.emplace(L"bar", u"C");
+	d.suffixes = {{u'S', true, L"", L"s", Flag_Set(), L"."}};
+	d.phonetic_table = {{L"B", L"B"}, {L"Z", L"S"}, {L"S", L"S"},
+	                    {L"K", L"K"}, {L"Y", L"_"}};
+	d.build_indexes();
+	d.build_word_prefix_index();
+	d.build_phonetic_index();
+	REQUIRE(d.build_word_form_dawg().built);
+	CHECK(d.compound_part_index.may_be_part(L"baz") == false);
+	CHECK(d.word_prefix_index.may_be_prefix(L"ba") == true);
+
+	auto word = wstring(L"baz");
+	CHECK(d.add_personal_word(word, L"foo") == true);
+	CHECK(d.word_form_dawg.complete() == false);
+	CHECK(d.spell_priv(L"baz") == true);
+	CHECK(d.spell_priv(L"bazs") == true);
+	CHECK(d.spell_priv(L"bazfoo") == true);
+	CHECK(d.spell_priv(L"foobar") == true);
+	CHECK(d.compound_part_index.may_be_part(L"baz") == true);
+	CHECK(d.word_prefix_index.may_be_prefix(L"baz") == true);
+
+	auto similar = vector<const Phonetic_Index::Entry*>();
+	d.phonetic_index.similar(L"BS", similar);
+	auto roots = vector<wstring>();
+	for (auto e : similar)
+		roots.push_back(e->second);
+	CHECK(roots == vector<wstring>{L"baz"});
+
+	// the deletion index is not built with compounding
+	auto d2 = Dict_Test();
+	d2.words.emplace(L"foo", u"S");
+	d2.suffixes = d.suffixes;
+	d2.build_indexes();
+	REQUIRE(d2.build_deletion_index(1, 100).built);
+	word = L"baz";
+	d2.add_personal_word(word, L"foo");
+	auto near = vector<wstring_view>();
+	d2.deletion_index.near_forms(L"bzs", 1, near);
+	CHECK(near == vector<wstring_view>{L"baz", L"bazs"});
+	d2.deletion_index.near_forms(L"fos", 1, near);
+	CHECK(near == vector<wstring_view>{L"foo", L"foos"});
+}
 TEST_CASE("Dictionary::spell_priv simple", "[dictionary]")
 {
 	auto d = Dict_Test();
@@ -208,6 +385,114 @@ TEST_CASE("Dictionary::spell_priv compounding triple", "[dictionary]")
 		CHECK(d.spell_priv(w) == false);
 }
 
+TEST_CASE("Dictionary::spell_priv compounding many parts", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.compound_flag = 'C';
+	d.compound_min_length = 1;
+	d.words.emplace(L"a", u"C");
+	d.words.emplace(L"aa", u"C");
+	d.words.emplace(L"aaa", u"C");
+
+	// Without memoization the number of splits to try is exponential.
+	auto good = wstring(60, 'a');
+	auto wrong = good + L'b';
+	CHECK(d.spell_priv(good) == true);
+	CHECK(d.spell_priv(wrong) == false);
+	wrong.insert(30, 1, 'b');
+	CHECK(d.spell_priv(wrong) == false);
+
+	// The memo is reused by the next checks of the thread.
+	for (auto n : {59, 7, 60}) {
+		auto w = wstring(n, 'a');
+		CHECK(d.spell_priv(w) == true);
+		w.back() = 'b';
+		CHECK(d.spell_priv(w) == false);
+		w.front() = 'b';
+		CHECK(d.spell_priv(w) == false);
+	}
+}
+
+TEST_CASE("Dict_Base::build_word_form_dawg", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.words.emplace(L"work", u"SDU");
+	d.words.emplace(L"try", u"SD");
+	d.words.emplace(L"need", u"X");
+	d.words.emplace(L"able", u"N");
+	d.need_affix_flag = u'N';
+	d.prefixes = {{u'U', true, L"", L"re", Flag_Set(), L"."}};
+	d.suffixes = {{u'S', true, L"", L"s", Flag_Set(), L"[^y]"},
+	              {u'S', true, L"y", L"ies", Flag_Set(), L"[^aeiou]y"},
+	              {u'D', true, L"", L"ed", Flag_Set(u"Y"), L"[^y]"},
+	              {u'D', true, L"y", L"ied", Flag_Set(), L"[^aeiou]y"},
+	              {u'Y', true, L"", L"ly", Flag_Set(), L"."},
+	              {u'X', false, L"", L"less", Flag_Set(), L"."},
+	              {u'N', false, L"", L"ness", Flag_Set(), L"."}};
+	d.build_indexes();
+
+	auto words = vector<wstring>{
+	    L"work",  L"works",    L"worked",  L"reworked", L"workedly",
+	    L"try",   L"tries",    L"tried",   L"trys",     L"retry",
+	    L"need",  L"needless", L"reneed",  L"able",     L"ableness",
+	    L"w",     L"workss",   L"worklyd", L"",         L"reworkedly"};
+	auto expected = vector<const Flag_Set*>();
+	for (auto& w : words)
+		expected.push_back(d.check_simple_word(w));
+	CHECK(expected[3] != nullptr);  // reworked
+	CHECK(expected[4] != nullptr);  // workedly
+	CHECK(expected[7] != nullptr);  // tried
+	CHECK(expected[8] == nullptr);  // trys
+	CHECK(expected[13] == nullptr); // able
+	CHECK(expected[14] != nullptr); // ableness
+
+	auto stats = d.build_word_form_dawg();
+	REQUIRE(stats.built == true);
+	CHECK(stats.forms < stats.candidates);
+	CHECK(stats.nodes != 0);
+	CHECK(stats.edges != 0);
+	CHECK(d.word_form_dawg.empty() == false);
+	for (size_t i = 0; i != words.size(); ++i) {
+		auto res = d.check_simple_word(words[i]);
+		CAPTURE(i);
+		REQUIRE((res != nullptr) == (expected[i] != nullptr));
+		if (res)
+			CHECK(*res == *expected[i]);
+	}
+	CHECK(d.build_word_form_dawg(3).built == false);
+	CHECK(d.word_form_dawg.empty() == true);
+}
+
+TEST_CASE("Dictionary::spell_priv compound part pruning", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.compound_flag = 'C';
+	d.words.emplace(L"foo", u"C");
+	d.words.emplace(L"bar", u"C");
+	d.words.emplace(L"city", u"CT");
+	d.words.emplace(L"xyz", u"");
+	d.prefixes = {{u'U', true, L"", L"un", Flag_Set(), L"."}};
+	d.suffixes = {{u'T', true, L"y", L"ies", Flag_Set(), L".[^aeiou]y"}};
+	d.build_indexes();
+
+	auto& index = d.compound_part_index;
+	CHECK(index.may_be_part(L"foo") == true);
+	CHECK(index.may_be_part(L"unbar") == true);
+	CHECK(index.may_be_part(L"cities") == true);
+	CHECK(index.may_be_part(L"xyz") == false);
+	CHECK(index.may_be_part(L"oof") == false);
+	CHECK(index.may_be_part(L"foobarfoo") == false);
+
+	Dict_Base::compounding_counters() = {};
+	auto w = wstring(L"foobarcity");
+	CHECK(d.spell_priv(w) == true);
+	w = L"fooxyz";
+	CHECK(d.spell_priv(w) == false);
+	auto& counters = Dict_Base::compounding_counters();
+	CHECK(counters.parts_checked != 0);
+	CHECK(counters.parts_pruned != 0);
+}
+
 TEST_CASE("Dictionary suggestions rep_suggest", "[dictionary]")
 {
 	auto d = Dict_Test();
@@ -369,6 +654,206 @@ TEST_CASE("Dictionary suggestions map_suggest", "[dictionary]")
 	CHECK(out_sug == expected_sug);
 }
 
+TEST_CASE("Dictionary suggestions map_suggest with prefix index",
+          "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.words.emplace(L"naïve", u"S");
+	d.words.emplace(L"café", u"U");
+	d.prefixes = {{u'U', false, L"", L"un", Flag_Set(), L"."}};
+	d.suffixes = {{u'S', false, L"e", L"ety", Flag_Set(), L"e"}};
+	d.similarities = {Similarity_Group<wchar_t>(L"iíìîï"),
+	                  Similarity_Group<wchar_t>(L"eéèêë"),
+	                  Similarity_Group<wchar_t>(L"aáàâä")};
+	d.build_indexes();
+	CHECK(d.word_prefix_index.empty());
+	CHECK(d.build_word_prefix_index());
+
+	auto& index = d.word_prefix_index;
+	CHECK(index.may_be_prefix(L"") == true);
+	CHECK(index.may_be_prefix(L"naï") == true);
+	CHECK(index.may_be_prefix(L"naïvet") == true);
+	CHECK(index.may_be_prefix(L"un") == true);
+	CHECK(index.may_be_prefix(L"uncaf") == true);
+	CHECK(index.may_be_prefix(L"ná") == false);
+	CHECK(index.may_be_prefix(L"naí") == false);
+	CHECK(index.may_be_prefix(L"naïvex") == false);
+	CHECK(index.may_be_prefix(L"ux") == false);
+
+	auto w = wstring(L"naivety");
+	auto out_sug = List_WStrings();
+	d.map_suggest(w, out_sug);
+	CHECK(out_sug == List_WStrings{L"naïvety"});
+	CHECK(w == L"naivety");
+
+	w = L"uncafe";
+	out_sug.clear();
+	d.map_suggest(w, out_sug);
+	CHECK(out_sug == List_WStrings{L"uncafé"});
+
+	d.compound_flag = u'C';
+	CHECK(d.build_word_prefix_index() == false);
+	CHECK(index.may_be_prefix(L"ná") == true);
+}
+
+TEST_CASE("Word_Prefix_Index::next_chars", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.words.emplace(L"cat", u"S");
+	d.words.emplace(L"cow", u"");
+	d.words.emplace(L"dog", u"");
+	d.prefixes = {{u'U', false, L"", L"un", Flag_Set(), L"."},
+	              {u'R', false, L"", L"re", Flag_Set(), L"."}};
+	d.suffixes = {{u'S', false, L"t", L"ps", Flag_Set(), L"t"}};
+	d.build_word_prefix_index();
+
+	auto& index = d.word_prefix_index;
+	auto chars = wstring();
+	CHECK(index.next_chars(L"", chars) == true);
+	CHECK(chars == L"cdpru");
+	CHECK(index.next_chars(L"c", chars) == true);
+	CHECK(chars == L"aop");
+	CHECK(index.next_chars(L"ca", chars) == true);
+	CHECK(chars == L"pt");
+	CHECK(index.next_chars(L"un", chars) == true);
+	CHECK(chars == L"cdp");
+	CHECK(index.next_chars(L"x", chars) == true);
+	CHECK(chars == L"");
+
+	// must agree with may_be_prefix()
+	for (auto s : {L"", L"c", L"ca", L"cap", L"u", L"un", L"unc", L"r"}) {
+		index.next_chars(s, chars);
+		for (auto c = L'a'; c <= L'z'; ++c) {
+			auto t = wstring(s) + c;
+			if (index.may_be_prefix(t))
+				CHECK(chars.find(c) != chars.npos);
+		}
+	}
+
+	d.compound_flag = u'C';
+	d.build_word_prefix_index();
+	CHECK(index.next_chars(L"x", chars) == false);
+}
+
+TEST_CASE("Dictionary suggestions guided by next chars", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.words.emplace(L"spell", u"");
+	d.words.emplace(L"spill", u"");
+	d.try_chars = L"abcdefghijklmnopqrstuvwxyz";
+	d.build_word_prefix_index();
+
+	auto w = wstring(L"spel");
+	auto out_sug = List_WStrings();
+	d.forgotten_char_suggest(w, out_sug);
+	CHECK(out_sug == List_WStrings{L"spell", L"spell"});
+	CHECK(w == L"spel");
+
+	w = L"spexl";
+	out_sug.clear();
+	d.bad_char_suggest(w, out_sug);
+	CHECK(out_sug == List_WStrings{L"spell"});
+
+	w = L"xpill";
+	out_sug.clear();
+	d.bad_char_suggest(w, out_sug);
+	CHECK(out_sug == List_WStrings{L"spill"});
+}
+
+TEST_CASE("Dictionary suggestions with deletion index", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.words.emplace(L"cat", u"S");
+	d.words.emplace(L"tact", u"");
+	d.words.emplace(L"table", u"U");
+	d.prefixes = {{u'U', false, L"", L"un", Flag_Set(), L"."}};
+	d.suffixes = {{u'S', true, L"", L"s", Flag_Set(), L"."}};
+	d.try_chars = L"abcdefghijklmnopqrstuvwxyz";
+
+	auto stats = d.build_deletion_index(2, 100);
+	REQUIRE(stats.built == true);
+	CHECK(stats.forms == 5);
+	CHECK(stats.deletions != 0);
+	CHECK(stats.memory != 0);
+	CHECK(d.deletion_index.max_distance() == 2);
+
+	auto near = vector<wstring_view>();
+	d.deletion_index.near_forms(L"cta", 1, near);
+	CHECK(near == vector<wstring_view>{L"cat", L"cats", L"tact"});
+	d.deletion_index.near_forms(L"untabel", 1, near);
+	CHECK(near == vector<wstring_view>{L"untable"});
+	d.deletion_index.near_forms(L"xyz", 2, near);
+	CHECK(near.empty());
+
+	auto test = [&](wstring w, auto f) {
+		auto out_sug = List_WStrings();
+		(d.*f)(w, out_sug);
+		auto out_slow = List_WStrings();
+		auto index = d.deletion_index;
+		d.deletion_index.clear();
+		(d.*f)(w, out_slow);
+		d.deletion_index = index;
+		CHECK(out_sug == out_slow);
+		return out_sug;
+	};
+	using D = Dict_Test;
+	CHECK(test(L"cta", &D::adjacent_swap_suggest) == List_WStrings{L"cat"});
+	CHECK(test(L"ttca", &D::distant_swap_suggest) ==
+	      List_WStrings{L"tact"});
+	CHECK(test(L"catx", &D::extra_char_suggest) == List_WStrings{L"cat"});
+	CHECK(test(L"tat", &D::forgotten_char_suggest) ==
+	      List_WStrings{L"tact"});
+	CHECK(test(L"caps", &D::bad_char_suggest) == List_WStrings{L"cats"});
+
+	d.compound_flag = u'C';
+	CHECK(d.build_deletion_index(1, 100).built == false);
+	CHECK(d.deletion_index.max_distance() == 0);
+}
+
+TEST_CASE("Dictionary suggestions two_words_suggest", "[dictionary]")
+{
+	auto d = Dict_Test();
+	d.words.emplace(L"a", u"");
+	d.words.emplace(L"at", u"");
+	d.words.emplace(L"cat", u"S");
+	d.words.emplace(L"sat", u"");
+	d.words.emplace(L"tea", u"");
+	d.suffixes = {{u'S', false, L"", L"s", Flag_Set(), L"."}};
+	d.try_chars = L"abcdefghijklmnopqrstuvwxyz";
+
+	auto w = wstring(L"catsat");
+	auto expected = List_WStrings{L"cat sat", L"cat-sat", L"cats at",
+	                              L"cats-at"};
+	auto out_sug = List_WStrings();
+	d.two_words_suggest(w, out_sug);
+	CHECK(out_sug == expected);
+	CHECK(w == L"catsat");
+
+	d.build_indexes();
+	d.build_word_prefix_index();
+	out_sug.clear();
+	d.two_words_suggest(w, out_sug);
+	CHECK(out_sug == expected);
+
+	w = L"atea";
+	out_sug.clear();
+	d.two_words_suggest(w, out_sug);
+	CHECK(out_sug == List_WStrings{L"a tea"});
+
+	REQUIRE(d.build_word_form_dawg().built);
+	auto lengths = vector<size_t>();
+	d.word_form_dawg.prefix_lengths(L"catsat", true, lengths);
+	CHECK(lengths == vector<size_t>{3, 4});
+	d.word_form_dawg.prefix_lengths(L"xcat", true, lengths);
+	CHECK(lengths.empty());
+
+	w = L"catsat";
+	out_sug.clear();
+	d.two_words_suggest(w, out_sug);
+	CHECK(out_sug == expected);
+	CHECK(w == L"catsat");
+}
+
 TEST_CASE("Dictionary suggestions keyboard_suggest", "[dictionary]")
 {
 	auto d = Dict_Test();
@@ -587,6 +1072,51 @@ TEST_CASE("Dictionary suggestions phonetic_suggest", "[dictionary]")
 }
 #endif
 
+TEST_CASE("Dictionary suggestions with phonetic index", "[dictionary]")
+{
+	auto d = Dict_Test();
+	auto words = {L"Brasilia",   L"brassily",   L"Brazilian",
+	              L"brilliance", L"brilliancy", L"brilliant",
+	              L"brain",      L"brass",      L"Churchillian",
+	              L"table"};
+	for (auto& x : words)
+		d.words.emplace(x, u"");
+	d.phonetic_table = {{L"B", L"B"},    {L"CH", L"X"}, {L"C(EIY)-", L"S"},
+	                    {L"C", L"K"},    {L"LL-", L"_"}, {L"L", L"L"},
+	                    {L"N", L"N"},    {L"R", L"R"},   {L"SS-", L"_"},
+	                    {L"S", L"S"},    {L"T", L"T"},   {L"Z", L"S"}};
+	d.build_indexes();
+	CHECK(d.phonetic_index.empty());
+	auto stats = d.build_phonetic_index();
+	CHECK(stats.built);
+	CHECK(stats.roots == 10);
+
+	auto code = wstring();
+	Phonetic_Index::code(d.phonetic_table, L"Brasillian", code);
+	CHECK(code == L"BRSLN");
+	Phonetic_Index::code(d.phonetic_table, L"brilliancy", code);
+	CHECK(code == L"BRLNS");
+
+	auto similar = vector<const Phonetic_Index::Entry*>();
+	d.phonetic_index.similar(L"BRSLN", similar);
+	auto roots = vector<wstring>();
+	for (auto e : similar)
+		roots.push_back(e->second);
+	CHECK(roots == vector<wstring>{L"brilliance", L"brilliancy",
+	                               L"brilliant", L"brain", L"brass",
+	                               L"Brasilia", L"brassily", L"Brazilian",
+	                               L"Churchillian"});
+
+	// The roots that contain a previous suggestion are skipped, of the
+	// others the two most similar are added.
+	auto w = wstring(L"brasillian");
+	auto out = List_WStrings{L"Brasilia", L"Brilliant", L"Brazilian"};
+	d.phonetic_ngram_suggest(w, out);
+	CHECK(w == L"brasillian");
+	CHECK(out == List_WStrings{L"Brasilia", L"Brilliant", L"Brazilian",
+	                           L"brassily", L"brilliance"});
+}
+
 #if 0
 TEST_CASE("long word", "[dictionary]")
 {
@@ -636,6 +1166,103 @@ TEST_CASE("Dictionary suggestions suggest_priv", "[dictionary]")
 	CHECK(words.size() == out_sug.size());
 }
 
+TEST_CASE("Dictionary suggestions suggest_priv with budget", "[dictionary]")
+{
+	auto d = Dict_Test();
+
+	d.try_chars = L"ailrt";
+	auto words = {L"tral", L"trial", L"trail", L"traalt"};
+	for (auto& x : words)
+		d.words.insert({x, {}});
+
+	auto& budget = Dict_Base::suggest_budget();
+	auto opt = Suggest_Options();
+	opt.max_candidates_checked = 9;
+	budget = Suggest_Budget(opt);
+	auto w = wstring(L"traal");
+	auto out_sug = List_WStrings();
+	d.suggest_priv(w, out_sug);
+	auto report = budget.get_report();
+	budget = Suggest_Budget();
+
+	// uppercase (1) + adjacent swap (6) + 2 from extra char
+	CHECK(report.budget_exhausted == true);
+	CHECK(report.candidates_checked == 9);
+	CHECK(out_sug == List_WStrings{L"tral"});
+	CHECK(report.was_skipped(Suggest_Stage::UPPERCASE) == false);
+	CHECK(report.was_skipped(Suggest_Stage::ADJACENT_SWAP) == false);
+	CHECK(report.was_skipped(Suggest_Stage::EXTRA_CHAR) == true);
+	CHECK(report.was_skipped(Suggest_Stage::BAD_CHAR) == true);
+	CHECK(report.was_skipped(Suggest_Stage::DISTANT_SWAP) == true);
+
+	opt.max_candidates_checked = 1000;
+	budget = Suggest_Budget(opt);
+	out_sug.clear();
+	d.suggest_priv(w, out_sug);
+	report = budget.get_report();
+	budget = Suggest_Budget();
+	CHECK(report.budget_exhausted == false);
+	CHECK(report.skipped_stages == 0);
+	CHECK(words.size() == out_sug.size());
+}
+
+TEST_CASE("Dictionary suggestions suggest_priv streaming", "[dictionary]")
+{
+	auto d = Dict_Test();
+
+	d.try_chars = L"ailrt";
+	d.replacements = {{L"aa", L"ia"}, {L"tra", L"tri"}};
+	auto words = {L"tral", L"trial", L"trail", L"traalt"};
+	for (auto& x : words)
+		d.words.insert({x, {}});
+
+	auto streamed = List_WStrings();
+	auto& sink = Dict_Base::suggestion_sink();
+	sink = [&](const wstring& sug) { streamed.push_back(sug); };
+	auto w = wstring(L"Traal");
+	auto out_sug = List_WStrings();
+	d.suggest_priv(w, out_sug);
+	sink = nullptr;
+
+	// the high quality REP suggestion comes first, already title cased
+	REQUIRE(streamed.empty() == false);
+	CHECK(streamed[0] == L"Trial");
+	auto expected = out_sug.extract_sequence();
+	auto got = streamed.extract_sequence();
+	sort(begin(expected), end(expected));
+	sort(begin(got), end(got));
+	got.erase(unique(begin(got), end(got)), end(got));
+	CHECK(got == expected);
+}
+
+TEST_CASE("Dictionary::suggest called from on_suggestion", "[dictionary]")
+{
+	auto aff = istringstream("SET UTF-8\nTRY ailrt\nREP 1\nREP aa ia\n");
+	auto dic = istringstream("4\ntral\ntrial\ntrail\ntable\n");
+	auto d = Dictionary::load_from_aff_dic(aff, dic);
+
+	auto expected = vector<string>();
+	d.suggest("traal", expected);
+	REQUIRE(expected.size() > 1);
+	auto expected_inner = vector<string>();
+	d.suggest("tabel", expected_inner);
+
+	auto streamed = vector<string>();
+	auto inner = vector<string>();
+	auto opt = Suggest_Options();
+	opt.on_suggestion = [&](const string& sug) {
+		streamed.push_back(sug);
+		d.suggest("tabel", inner);
+	};
+	auto out = vector<string>();
+	d.suggest("traal", out, opt);
+	CHECK(out == expected);
+	CHECK(inner == expected_inner);
+	sort(begin(streamed), end(streamed));
+	sort(begin(expected), end(expected));
+	CHECK(streamed == expected);
+}
+
 #if 0
 TEST_CASE("suggest_priv_max", "[dictionary]")
 {
@@ -0,0 +1,125 @@
+/* Copyright 2016-2019 Dimitrij Mijoski
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nuspell/finder.hxx>
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+
+#include <catch2/catch.hpp>
+
+#if defined(__unix__) || defined(__unix) ||                                    \
+    (defined(__APPLE__) && defined(__MACH__))
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+using namespace std;
+using namespace nuspell;
+
+namespace {
+auto touch(const string& path) { ofstream(path).put('\n'); }
+auto set_mtime(const string& path, time_t t)
+{
+	auto times = utimbuf{t, t};
+	return utime(path.c_str(), &times) == 0;
+}
+
+// sets an environment variable until the end of the scope
+class Env_Override {
+	string name;
+	bool was_set;
+	string old_value;
+
+      public:
+	Env_Override(const string& var, const string& value) : name(var)
+	{
+		auto old = getenv(name.c_str());
+		was_set = old != nullptr;
+		if (was_set)
+			old_value = old;
+		setenv(name.c_str(), value.c_str(), 1);
+	}
+	~Env_Override()
+	{
+		if (was_set)
+			setenv(name.c_str(), old_value.c_str(), 1);
+		else
+			unsetenv(name.c_str());
+	}
+};
+} // namespace
+
+TEST_CASE("Finder::search_for_dictionaries with cache", "[finder]")
+{
+	char tmp[] = "/tmp/nuspell_finder_test_XXXXXX";
+	REQUIRE(mkdtemp(tmp));
+	auto root = string(tmp);
+	auto dicts = root + "/dicts";
+	auto cache = root + "/cache/nuspell/dictionaries";
+	REQUIRE(mkdir(dicts.c_str(), 0755) == 0);
+	touch(dicts + "/aa_AA.aff");
+	touch(dicts + "/aa_AA.dic");
+	touch(dicts + "/bb_BB.dic");
+	auto an_hour_ago = time(nullptr) - 3600;
+	REQUIRE(set_mtime(dicts, an_hour_ago));
+	auto dicpath = Env_Override("DICPATH", dicts);
+	auto home = Env_Override("HOME", root);
+
+	auto f = Finder();
+	f.add_default_dir_paths();
+	f.search_for_dictionaries(cache);
+	CHECK(f.get_dictionary_path("aa_AA") == dicts + "/aa_AA");
+	CHECK(f.get_dictionary_path("bb_BB") == "");
+	CHECK(f.get_stats().from_cache == 0);
+	CHECK(f.get_stats().cache_written);
+
+	auto g = Finder();
+	g.add_default_dir_paths();
+	g.search_for_dictionaries(cache);
+	CHECK(g.get_dictionaries() == f.get_dictionaries());
+	CHECK(g.get_stats().from_cache >= 1);
+	CHECK(g.get_stats().cache_written == false);
+
+	// a changed directory is searched again
+	touch(dicts + "/bb_BB.aff");
+	REQUIRE(set_mtime(dicts, an_hour_ago + 1));
+	auto h = Finder();
+	h.add_default_dir_paths();
+	h.search_for_dictionaries(cache);
+	CHECK(h.get_dictionary_path("bb_BB") == dicts + "/bb_BB");
+	CHECK(h.get_stats().from_cache == g.get_stats().from_cache - 1);
+	CHECK(h.get_stats().cache_written);
+
+	// the same result without cache
+	auto k = Finder();
+	k.add_default_dir_paths();
+	k.search_for_dictionaries();
+	CHECK(k.get_dictionaries() == h.get_dictionaries());
+
+	for (auto name : {"aa_AA.aff", "aa_AA.dic", "bb_BB.aff", "bb_BB.dic"})
+		remove((dicts + '/' + name).c_str());
+	remove(cache.c_str());
+	rmdir((root + "/cache/nuspell").c_str());
+	rmdir((root + "/cache").c_str());
+	rmdir(dicts.c_str());
+	rmdir(root.c_str());
+}
+#endif
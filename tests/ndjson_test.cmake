@@ -0,0 +1,17 @@
+# Runs the command line tool with -J on a file and compares its output with
+# the expected one. Used with cmake -P, with the variables NUSPELL (the
+# executable), DICT (the dictionary path without extension), ENCODING, INPUT
+# and EXPECTED.
+
+set(ENV{NUSPELL_NO_CACHE} 1)
+execute_process(
+    COMMAND ${NUSPELL} -J -i ${ENCODING} -d ${DICT} ${INPUT}
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "nuspell exited with ${result}")
+endif()
+file(READ ${EXPECTED} expected)
+if (NOT output STREQUAL expected)
+    message(FATAL_ERROR "Unexpected output:\n${output}\nExpected:\n${expected}")
+endif()
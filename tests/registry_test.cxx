@@ -0,0 +1,144 @@
+/* Copyright 2016-2019 Dimitrij Mijoski
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nuspell/registry.hxx>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <catch2/catch.hpp>
+
+#if defined(__unix__) || defined(__unix) ||                                    \
+    (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+
+using namespace std;
+using namespace nuspell;
+
+TEST_CASE("Dictionary_Registry", "[registry]")
+{
+	char tmp[] = "/tmp/nuspell_registry_test_XXXXXX";
+	REQUIRE(mkdtemp(tmp));
+	auto dir = string(tmp);
+	auto en = dir + "/en_XX";
+	auto de = dir + "/de_XX";
+	ofstream(en + ".aff") << "SET UTF-8\n";
+	ofstream(en + ".dic") << "2\ntable\nchair\n";
+	ofstream(de + ".aff") << "SET UTF-8\n";
+	ofstream(de + ".dic") << "2\ntisch\nstuhl\n";
+
+	auto reg = Dictionary_Registry();
+	auto a = reg.get(en);
+	REQUIRE(a);
+	CHECK(a->spell("table"));
+	CHECK(reg.get(en) == a);
+	auto en_size = reg.memory_usage();
+	CHECK(en_size > 0);
+
+	auto threads = vector<thread>();
+	auto results = vector<shared_ptr<const Dictionary>>(8);
+	for (auto& r : results)
+		threads.emplace_back([&]() { r = reg.get(de); });
+	for (auto& t : threads)
+		t.join();
+	for (auto& r : results)
+		CHECK(r == results[0]);
+	CHECK(results[0]->spell("tisch"));
+	auto total_size = reg.memory_usage();
+	CHECK(total_size > en_size);
+
+	// only idle dictionaries are evicted
+	reg.set_memory_budget(0);
+	CHECK(reg.memory_usage() == total_size);
+	results.clear();
+	reg.trim();
+	CHECK(reg.memory_usage() == en_size);
+	auto a_weak = weak_ptr<const Dictionary>(a);
+	a.reset();
+	reg.trim();
+	CHECK(reg.memory_usage() == 0);
+	CHECK(a_weak.expired());
+
+	reg.set_memory_budget(-1);
+	reg.preload({en, de, dir + "/xx_XX"});
+	CHECK_THROWS_AS(reg.get(dir + "/xx_XX"), Dictionary_Loading_Error);
+	CHECK_THROWS_AS(reg.get("xx_XX"), Dictionary_Loading_Error);
+	CHECK(reg.get(de)->spell("stuhl"));
+	CHECK(reg.get(en)->spell("chair"));
+	CHECK(reg.memory_usage() == total_size);
+
+	// failed loads are never seen by the eviction of other threads
+	auto bad = dir + "/bad_XX";
+	ofstream(bad + ".aff") << "SET UTF-8\n";
+	ofstream(bad + ".dic") << "no word count\n";
+	reg.set_memory_budget(0);
+	auto failures = vector<int>(8);
+	threads.clear();
+	for (size_t i = 0; i != failures.size(); ++i) {
+		threads.emplace_back([&, i]() {
+			for (auto j = 0; j != 20; ++j) {
+				try {
+					reg.get(j % 2 ? en : bad);
+				}
+				catch (const Dictionary_Loading_Error&) {
+					++failures[i];
+				}
+			}
+		});
+	}
+	for (auto& t : threads)
+		t.join();
+	for (auto n : failures)
+		CHECK(n == 10);
+	reg.trim();
+	CHECK(reg.memory_usage() == 0);
+
+	// threads waiting for a load keep it from eviction by other loads
+	auto big = dir + "/big_XX";
+	ofstream(big + ".aff") << "SET UTF-8\n";
+	{
+		auto f = ofstream(big + ".dic");
+		f << 100000 << '\n';
+		for (auto i = 0; i != 100000; ++i)
+			f << "word" << i << '\n';
+	}
+	for (auto round = 0; round != 3; ++round) {
+		auto reg2 = Dictionary_Registry();
+		reg2.set_memory_budget(0);
+		reg2.preload({big, de});
+		// let the preloader start, the threads below wait for it
+		this_thread::sleep_for(chrono::milliseconds(20));
+		threads.clear();
+		results.assign(8, nullptr);
+		for (auto& r : results)
+			threads.emplace_back([&]() { r = reg2.get(big); });
+		for (auto& t : threads)
+			t.join();
+		for (auto& r : results)
+			CHECK(r == results[0]);
+		CHECK(reg2.get(big) == results[0]);
+	}
+
+	for (auto& p : {en, de, bad, big}) {
+		remove((p + ".aff").c_str());
+		remove((p + ".dic").c_str());
+	}
+	rmdir(dir.c_str());
+}
+#endif
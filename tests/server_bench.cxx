@@ -0,0 +1,425 @@
+/* Copyright 2020 Dimitrij Mijoski, Sander van Geloven
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+enum Mode {
+	SPELL_MODE /**< send spell requests */,
+	SUGGEST_MODE /**< send suggest requests */,
+	HELP_MODE /**< printing help information */,
+	ERROR_MODE /**< where the arguments used caused an error */
+};
+
+struct Args_t {
+	Mode mode = SPELL_MODE;
+	string program_name = "server_bench";
+	string dictionary = "en_US";
+	string executable = "nuspell";
+	size_t requests = 0;
+	size_t window = 256;
+	vector<string> files;
+
+	Args_t() = default;
+	Args_t(int argc, char* argv[]) { parse_args(argc, argv); }
+	auto parse_args(int argc, char* argv[]) -> void;
+};
+
+auto Args_t::parse_args(int argc, char* argv[]) -> void
+{
+	if (argc != 0 && argv[0] && argv[0][0] != '\0')
+		program_name = argv[0];
+	int c;
+	const char* shortopts = ":d:n:w:x:sh";
+	const struct option longopts[] = {
+	    {"help", 0, nullptr, 'h'},
+	    {nullptr, 0, nullptr, 0},
+	};
+	while ((c = getopt_long(argc, argv, shortopts, longopts, nullptr)) !=
+	       -1) {
+		switch (c) {
+		case 'd':
+			dictionary = optarg;
+
+			break;
+		case 'n':
+			requests = strtoul(optarg, nullptr, 10);
+
+			break;
+		case 'w':
+			window = max<size_t>(strtoul(optarg, nullptr, 10), 1);
+
+			break;
+		case 'x':
+			executable = optarg;
+
+			break;
+		case 's':
+			if (mode == SPELL_MODE)
+				mode = SUGGEST_MODE;
+			else
+				mode = ERROR_MODE;
+
+			break;
+		case 'h':
+			if (mode == SPELL_MODE)
+				mode = HELP_MODE;
+			else
+				mode = ERROR_MODE;
+
+			break;
+		case ':':
+			cerr << "Option -" << static_cast<char>(optopt)
+			     << " requires an operand\n";
+			mode = ERROR_MODE;
+
+			break;
+		case '?':
+			cerr << "Unrecognized option: '-"
+			     << static_cast<char>(optopt) << "'\n";
+			mode = ERROR_MODE;
+
+			break;
+		}
+	}
+	files.insert(files.end(), argv + optind, argv + argc);
+}
+
+/**
+ * @brief Prints help information to standard output.
+ *
+ * @param program_name pass argv[0] here.
+ */
+auto print_help(const string& program_name) -> void
+{
+	auto& p = program_name;
+	auto& o = cout;
+	o << "Usage:\n"
+	     "\n";
+	o << p << " [-s] [-d dict_NAME] [-n num] [-w num] [-x nuspell] "
+	          "[file_name]...\n";
+	o << p << " -h|--help\n";
+	o << "\n"
+	     "Start nuspell --server and measure its throughput and latency "
+	     "for the\n"
+	     "words in FILE, one word per line. Without FILE, read standard "
+	     "input.\n"
+	     "\n"
+	     "  -d di_CT      use di_CT dictionary, default en_US\n"
+	     "  -n num        send num requests, repeating the words as "
+	     "needed,\n"
+	     "                default is one request per word\n"
+	     "  -w num        keep at most num requests without response, "
+	     "default\n"
+	     "                256, 1 disables pipelining\n"
+	     "  -x nuspell    path to the nuspell executable\n"
+	     "  -s            send suggest requests instead of spell\n"
+	     "  -h, --help    print this help and exit\n"
+	     "\n";
+	o << "Example: " << p << " -d en_US -x build/src/nuspell/nuspell "
+	                         "words.txt\n";
+	o << "\n"
+	     "Statistics are printed to standard output, being:\n"
+	     "  Startup Duration (starting the server and loading the "
+	     "dictionary)\n"
+	     "  Requests\n"
+	     "  Errors\n"
+	     "  Total Duration\n"
+	     "  Requests Per Second\n"
+	     "  Average Latency\n"
+	     "  Median Latency\n"
+	     "  P99 Latency (99th percentile)\n"
+	     "  Max Latency\n"
+	     "All durations are in nanoseconds and are highly machine and "
+	     "platform\n"
+	     "dependent. Use only executable from production build with "
+	     "optimizations.\n";
+}
+
+/**
+ * @brief Server child process connected with pipes.
+ */
+class Server_Process {
+	pid_t pid = -1;
+	int to_server = -1;
+	int from_server = -1;
+	string in_buf;
+	size_t in_pos = 0;
+
+      public:
+	Server_Process(const string& executable, const string& dictionary);
+	Server_Process(const Server_Process&) = delete;
+	auto operator=(const Server_Process&) -> Server_Process& = delete;
+	~Server_Process();
+	auto started() const { return pid != -1; }
+	auto write(const string& data) -> bool;
+	auto close_input() -> void;
+	auto read_line(string& line) -> bool;
+};
+
+Server_Process::Server_Process(const string& executable,
+                               const string& dictionary)
+{
+	int to[2], from[2];
+	if (pipe(to) == -1)
+		return;
+	if (pipe(from) == -1) {
+		close(to[0]);
+		close(to[1]);
+		return;
+	}
+	pid = fork();
+	if (pid == 0) {
+		dup2(to[0], STDIN_FILENO);
+		dup2(from[1], STDOUT_FILENO);
+		close(to[0]);
+		close(to[1]);
+		close(from[0]);
+		close(from[1]);
+		execlp(executable.c_str(), executable.c_str(), "--server", "-d",
+		       dictionary.c_str(), nullptr);
+		_exit(127);
+	}
+	close(to[0]);
+	close(from[1]);
+	to_server = to[1];
+	from_server = from[0];
+	if (pid == -1) {
+		close_input();
+		close(from_server);
+		from_server = -1;
+	}
+}
+
+Server_Process::~Server_Process()
+{
+	close_input();
+	if (from_server != -1)
+		close(from_server);
+	if (pid != -1)
+		waitpid(pid, nullptr, 0);
+}
+
+auto Server_Process::write(const string& data) -> bool
+{
+	for (size_t i = 0; i != data.size();) {
+		auto n = ::write(to_server, data.data() + i, data.size() - i);
+		if (n == -1)
+			return false;
+		i += n;
+	}
+	return true;
+}
+
+auto Server_Process::close_input() -> void
+{
+	if (to_server != -1)
+		close(to_server);
+	to_server = -1;
+}
+
+auto Server_Process::read_line(string& line) -> bool
+{
+	for (;;) {
+		auto eol = in_buf.find('\n', in_pos);
+		if (eol != in_buf.npos) {
+			line.assign(in_buf, in_pos, eol - in_pos);
+			in_pos = eol + 1;
+			return true;
+		}
+		in_buf.erase(0, in_pos);
+		in_pos = 0;
+		char buf[1 << 16];
+		auto n = read(from_server, buf, sizeof(buf));
+		if (n <= 0)
+			return false;
+		in_buf.append(buf, n);
+	}
+}
+
+auto append_request(string& out, size_t id, const char* command,
+                    const string& dictionary, const string& word)
+{
+	out += to_string(id);
+	out += '\t';
+	out += command;
+	out += '\t';
+	out += dictionary;
+	out += '\t';
+	out += word;
+	out += '\n';
+}
+
+int main(int argc, char* argv[])
+{
+	// May speed up I/O. After this, don't use C printf, scanf etc.
+	ios_base::sync_with_stdio(false);
+
+	auto args = Args_t(argc, argv);
+	if (args.mode == ERROR_MODE) {
+		cerr << "Invalid (combination of) arguments, try '"
+		     << args.program_name << " --help' for more information\n";
+		return 1;
+	}
+	if (args.mode == HELP_MODE) {
+		print_help(args.program_name);
+		return 0;
+	}
+	auto words = vector<string>();
+	auto read_words = [&](istream& in) {
+		for (auto word = string(); getline(in, word);)
+			if (!word.empty())
+				words.push_back(word);
+	};
+	if (args.files.empty())
+		read_words(cin);
+	for (auto& file_name : args.files) {
+		ifstream in(file_name);
+		if (!in.is_open()) {
+			cerr << "Can't open " << file_name << '\n';
+			return 1;
+		}
+		read_words(in);
+	}
+	if (words.empty()) {
+		cerr << "No words to send\n";
+		return 1;
+	}
+	auto n_requests = args.requests ? args.requests : words.size();
+	auto command = args.mode == SUGGEST_MODE ? "suggest" : "spell";
+
+	// A server that exits early must not kill us while writing to it.
+	signal(SIGPIPE, SIG_IGN);
+	using clock = chrono::steady_clock;
+	auto start = clock::now();
+	auto server = Server_Process(args.executable, args.dictionary);
+	if (!server.started()) {
+		cerr << "Can't start " << args.executable << '\n';
+		return 1;
+	}
+	// The server loads the dictionary before reading requests.
+	auto request = string();
+	auto response = string();
+	append_request(request, n_requests, "spell", args.dictionary,
+	               words[0]);
+	if (!server.write(request) || !server.read_line(response)) {
+		cerr << "The server did not respond\n";
+		return 1;
+	}
+	auto startup = clock::now() - start;
+
+	auto mtx = mutex();
+	auto window_free = condition_variable();
+	auto in_flight = size_t(0);
+	auto sent_at = vector<clock::time_point>(n_requests);
+	auto latencies = vector<chrono::nanoseconds>();
+	latencies.reserve(n_requests);
+	auto errors = size_t(0);
+	auto bad_responses = false;
+
+	start = clock::now();
+	auto reader = thread([&]() {
+		auto line = string();
+		for (size_t i = 0; i != n_requests; ++i) {
+			if (!server.read_line(line))
+				break;
+			auto tab = line.find('\t');
+			auto id = strtoul(line.c_str(), nullptr, 10);
+			if (tab == line.npos || id >= n_requests)
+				break;
+			if (line.compare(tab + 1, 3, "ok\t") != 0 &&
+			    line.compare(tab + 1, string::npos, "ok") != 0)
+				++errors;
+			auto now = clock::now();
+			auto lock = unique_lock<mutex>(mtx);
+			latencies.push_back(now - sent_at[id]);
+			--in_flight;
+			lock.unlock();
+			window_free.notify_one();
+		}
+		// Unblock the writer if the server stopped responding.
+		auto lock = unique_lock<mutex>(mtx);
+		in_flight = 0;
+		bad_responses = latencies.size() != n_requests;
+		window_free.notify_one();
+	});
+	request.clear();
+	for (size_t i = 0; i != n_requests; ++i) {
+		auto lock = unique_lock<mutex>(mtx);
+		if (in_flight == args.window || request.size() >= (1 << 16)) {
+			lock.unlock();
+			if (!server.write(request))
+				break;
+			request.clear();
+			lock.lock();
+		}
+		window_free.wait(lock,
+		                 [&]() { return in_flight < args.window; });
+		if (bad_responses)
+			break;
+		++in_flight;
+		sent_at[i] = clock::now();
+		lock.unlock();
+		append_request(request, i, command, args.dictionary,
+		               words[i % words.size()]);
+	}
+	server.write(request);
+	server.close_input();
+	reader.join();
+	auto duration = clock::now() - start;
+	if (bad_responses) {
+		cerr << "Missing or malformed responses from the server\n";
+		return 1;
+	}
+
+	sort(begin(latencies), end(latencies));
+	auto total_latency = chrono::nanoseconds();
+	for (auto l : latencies)
+		total_latency += l;
+	auto& out = cout;
+	auto ns = [](auto d) {
+		return chrono::duration_cast<chrono::nanoseconds>(d).count();
+	};
+	out << "Startup Duration    " << ns(startup) << '\n';
+	out << "Requests            " << n_requests << '\n';
+	out << "Errors              " << errors << '\n';
+	out << "Total Duration      " << ns(duration) << '\n';
+	out << "Requests Per Second "
+	    << n_requests / chrono::duration<double>(duration).count() << '\n';
+	out << "Average Latency     " << ns(total_latency) / n_requests << '\n';
+	out << "Median Latency      " << ns(latencies[n_requests / 2]) << '\n';
+	out << "P99 Latency         " << ns(latencies[n_requests * 99 / 100])
+	    << '\n';
+	out << "Max Latency         " << ns(latencies.back()) << '\n';
+	return 0;
+}
@@ -0,0 +1,81 @@
+/* Copyright 2016-2019 Dimitrij Mijoski
+ *
+ * This file is part of Nuspell.
+ *
+ * Nuspell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nuspell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Nuspell.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nuspell/server.hxx>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <catch2/catch.hpp>
+
+#if defined(__unix__) || defined(__unix) ||                                    \
+    (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+
+using namespace std;
+using namespace nuspell;
+
+TEST_CASE("handle_request", "[server]")
+{
+	char tmp[] = "/tmp/nuspell_server_test_XXXXXX";
+	REQUIRE(mkdtemp(tmp));
+	auto en = string(tmp) + "/en_XX";
+	ofstream(en + ".aff") << "SET UTF-8\nTRY abcdefghijklmnopqrstuvwxyz\n";
+	ofstream(en + ".dic") << "2\ntable\nchair\n";
+
+	auto reg = Dictionary_Registry();
+	auto sugs = vector<string>();
+	auto response = string();
+	auto handle = [&](const string& request) {
+		handle_request(request, reg, sugs, response);
+		return response;
+	};
+	CHECK(handle("1\tspell\t" + en + "\ttable") == "1\tok\t1\n");
+	CHECK(handle("2\tspell\t" + en + "\ttabel") == "2\tok\t0\n");
+	CHECK(handle("3\tsuggest\t" + en + "\ttabel") == "3\tok\ttable\n");
+	CHECK(handle("4\tsuggest\t" + en + "\txyzxyzxyz") == "4\tok\n");
+
+	CHECK(handle("5\tspell\t" + en) == "5\terr\tbad request\n");
+	CHECK(handle("6\tspell\t" + en + "\ta\tb") == "6\terr\tbad request\n");
+	CHECK(handle("") == "\terr\tbad request\n");
+	CHECK(handle("7\tcheck\t" + en + "\ttable") ==
+	      "7\terr\tunknown command\n");
+	CHECK(handle("8\tspell\tnonexistent_XX\ttable") ==
+	      "8\terr\tunknown dictionary\n");
+
+	// the responses can come in any order
+	auto in = istringstream("a\tspell\t" + en + "\tchair\n" +
+	                        "b\tspell\t" + en + "\n" + //
+	                        "c\tsuggest\t" + en + "\tchiar\n");
+	auto out = ostringstream();
+	serve(in, out, reg, 2);
+	auto lines = vector<string>();
+	auto out_in = istringstream(out.str());
+	for (auto line = string(); getline(out_in, line);)
+		lines.push_back(line);
+	sort(begin(lines), end(lines));
+	CHECK(lines == vector<string>{"a\tok\t1", "b\terr\tbad request",
+	                              "c\tok\tchair"});
+
+	remove((en + ".aff").c_str());
+	remove((en + ".dic").c_str());
+	rmdir(tmp);
+}
+#endif
@@ -20,6 +20,8 @@
 
 #include <catch2/catch.hpp>
 
+#include <random>
+
 using namespace std;
 using namespace nuspell;
 
@@ -184,6 +186,70 @@ TEST_CASE("Substr_Replacer", "[structures]")
 	      "bb XYZ d f hh ii ll");
 }
 
+namespace {
+// Straightforward reference, tries every key at every position.
+auto substr_replace_reference(const vector<pair<string, string>>& table,
+                              const string& s) -> string
+{
+	auto out = string();
+	for (size_t i = 0; i != s.size();) {
+		const pair<string, string>* match = nullptr;
+		for (auto& p : table) {
+			if (p.first.empty() ||
+			    s.compare(i, p.first.size(), p.first) != 0)
+				continue;
+			if (!match || p.first.size() > match->first.size())
+				match = &p;
+		}
+		if (match) {
+			out += match->second;
+			i += match->first.size();
+		}
+		else {
+			out += s[i++];
+		}
+	}
+	return out;
+}
+} // namespace
+
+TEST_CASE("Substr_Replacer longest match", "[structures]")
+{
+	auto rep =
+	    Substr_Replacer<char>({{"b", "1"}, {"bb", "2"}, {"bcd", "3"}});
+	CHECK(rep.replace_copy("bcbbbcdb") == "1c231");
+	CHECK(rep.replace_copy("xyz") == "xyz");
+}
+
+TEST_CASE("Substr_Replacer random against reference", "[structures]")
+{
+	auto rng = minstd_rand(12345);
+	auto alphabet = string("abc\xE9");
+	auto rand_str = [&](size_t max_len) {
+		auto len = rng() % (max_len + 1);
+		auto str = string();
+		for (size_t i = 0; i != len; ++i)
+			str += alphabet[rng() % alphabet.size()];
+		return str;
+	};
+	for (int n = 0; n != 3000; ++n) {
+		// which pair of a duplicated key wins is unspecified
+		auto table = vector<pair<string, string>>();
+		for (auto num_pairs = rng() % 7; num_pairs != 0; --num_pairs) {
+			auto from = rand_str(3);
+			if (none_of(begin(table), end(table),
+			            [&](auto& p) { return p.first == from; }))
+				table.emplace_back(from, rand_str(3));
+		}
+		auto rep = Substr_Replacer<char>(table);
+		for (int k = 0; k != 5; ++k) {
+			auto str = rand_str(12);
+			CHECK(rep.replace_copy(str) ==
+			      substr_replace_reference(table, str));
+		}
+	}
+}
+
 TEST_CASE("Break_Table", "[structures]")
 {
 	auto a = Break_Table<char>();
@@ -548,6 +614,40 @@ TEST_CASE("match_simple_regex", "[structures]")
 	CHECK_FALSE(match_simple_regex("qwerty"s, "abc?de*ff"s));
 }
 
+TEST_CASE("Compound_Rule_Table", "[structures]")
+{
+	auto rules = vector<u16string>{u"abc?de*ff", u"a*b?c", u"x?y*"};
+	auto table = Compound_Rule_Table(rules);
+
+	// compare the compiled automaton with matching each rule separately
+	auto flag_sets = vector<Flag_Set>{u"a",  u"b",  u"c",  u"d",  u"e",
+	                                  u"f",  u"x",  u"y",  u"ab", u"bc",
+	                                  u"ef", u"xy", u"q"};
+	auto data = vector<const Flag_Set*>();
+	auto check_all = [&](auto& self, size_t depth) -> void {
+		auto expected = any_of(begin(rules), end(rules), [&](auto& r) {
+			return match_compund_rule(data, r);
+		});
+		CHECK(table.match_any_rule(data) == expected);
+		if (depth == 4)
+			return;
+		for (auto& f : flag_sets) {
+			data.push_back(&f);
+			self(self, depth + 1);
+			data.pop_back();
+		}
+	};
+	check_all(check_all, 0);
+
+	auto s = table.initial_state();
+	auto s2 = Compound_Rule_Table::State();
+	CHECK(table.is_accepting(s));
+	CHECK(table.advance(s, Flag_Set(u"a"), s2));
+	CHECK(table.can_advance(s2));
+	CHECK_FALSE(table.advance(s, Flag_Set(u"q"), s2));
+	CHECK_FALSE(table.can_advance(s2));
+}
+
 TEST_CASE("List_Strings", "[structures]")
 {
 	auto l = List_Strings();
@@ -584,6 +684,117 @@ TEST_CASE("List_Strings", "[structures]")
 	CHECK(begin(l) == end(l));
 }
 
+TEST_CASE("List_Strings_Set", "[structures]")
+{
+	auto l = List_Strings();
+	auto s = List_Strings_Set<char>(l);
+	CHECK(s.contains("") == false);
+	CHECK(s.contains_substring_of("abc") == false);
+
+	l.push_back("cat");
+	l.push_back("dog");
+	CHECK(s.contains("cat"));
+	CHECK(s.contains("dog"));
+	CHECK(s.contains("do") == false);
+	l.push_back("do");
+	CHECK(s.contains("do"));
+	CHECK(s.contains_substring_of("undo"));
+	CHECK(s.contains_substring_of("scats"));
+	CHECK(s.contains_substring_of("ca") == false);
+
+	for (auto i = 0; i != 100; ++i)
+		l.push_back(to_string(i % 40));
+	l.push_back("cat");
+	CHECK(s.contains("39"));
+	CHECK(s.contains("40") == false);
+
+	List_Strings_Set<char>::remove_duplicates(l);
+	CHECK(l.size() == 43);
+	CHECK(l[0] == "cat");
+	CHECK(l[1] == "dog");
+	CHECK(l[2] == "do");
+	CHECK(l[3] == "0");
+	CHECK(l[42] == "39");
+
+	l[0] = "cow";
+	auto s2 = List_Strings_Set<char>(l);
+	CHECK(s2.contains("cow"));
+	CHECK(s2.contains("cat") == false);
+	CHECK(s2.contains("17"));
+}
+
+TEST_CASE("Replacement_Table::for_each_match", "[structures]")
+{
+	using Match = pair<const pair<string, string>*, size_t>;
+	auto find_all = [](const Replacement_Table<char>& t, const string& w) {
+		auto ret = vector<Match>();
+		t.for_each_match(w, [&](auto& r, size_t i) {
+			ret.emplace_back(&r, i);
+			return false;
+		});
+		sort(begin(ret), end(ret));
+		return ret;
+	};
+	// what rep_suggest() did before, searching each entry separately
+	auto find_all_slow = [](const Replacement_Table<char>& t,
+	                        const string& w) {
+		auto ret = vector<Match>();
+		for (auto& r : t.whole_word_replacements())
+			if (w == r.first)
+				ret.emplace_back(&r, 0);
+		for (auto& r : t.start_word_replacements())
+			if (w.compare(0, r.first.size(), r.first) == 0)
+				ret.emplace_back(&r, 0);
+		for (auto& r : t.end_word_replacements())
+			if (w.size() >= r.first.size() &&
+			    w.compare(w.size() - r.first.size(), r.first.size(),
+			              r.first) == 0)
+				ret.emplace_back(&r, w.size() - r.first.size());
+		for (auto& r : t.any_place_replacements())
+			for (auto i = w.find(r.first); i != w.npos;
+			     i = w.find(r.first, i + 1))
+				ret.emplace_back(&r, i);
+		sort(begin(ret), end(ret));
+		return ret;
+	};
+
+	auto t = Replacement_Table<char>({{"^ab$", "x"},
+	                                  {"^a", "x"},
+	                                  {"b$", "x"},
+	                                  {"ab", "x"},
+	                                  {"b", "x"},
+	                                  {"bab", "x"}});
+	auto m = find_all(t, "abab");
+	CHECK(m.size() == 7);
+	CHECK(m == find_all_slow(t, "abab"));
+	CHECK(find_all(t, "ab").size() == 5);
+
+	auto rng = minstd_rand(54321);
+	auto rand_str = [&](size_t min_len, size_t max_len) {
+		auto len = min_len + rng() % (max_len - min_len + 1);
+		auto str = string();
+		for (size_t i = 0; i != len; ++i)
+			str += "abc"[rng() % 3];
+		return str;
+	};
+	for (int n = 0; n != 1000; ++n) {
+		auto pairs = vector<pair<string, string>>(rng() % 8);
+		for (auto& [from, to] : pairs) {
+			from = rand_str(1, 3);
+			auto anchor = rng() % 4;
+			if (anchor & 1)
+				from.insert(0, 1, '^');
+			if (anchor & 2)
+				from += '$';
+		}
+		t = pairs;
+		for (int k = 0; k != 5; ++k) {
+			auto w = rand_str(0, 10);
+			CHECK(find_all(t, w) == find_all_slow(t, w));
+		}
+	}
+}
+
 TEST_CASE("Similarity_Group", "[structures]")
 {
 	auto s1 = Similarity_Group<char>();
@@ -653,4 +864,338 @@ TEST_CASE("Phonetic_Table", "[structures]")
 	CHECK(exp == word);
 	CHECK(false == f5.replace(word));
 	CHECK(exp == word);
+
+	// code() drops the characters that no rule matches
+	word = string("AABCCAMB");
+	f5.code(word);
+	CHECK(word == "BBM");
+}
+
+namespace {
+// The interpreter of the rule patterns that Phonetic_Table used before the
+// rules were parsed ahead, kept as reference.
+struct Phonet_Reference_Match {
+	size_t count_matched = 0;
+	size_t go_back_before_replace = 0;
+	size_t priority = 5;
+	bool go_back_after_replace = false;
+	bool treat_next_as_begin = false;
+};
+auto phonet_reference_match(const wstring& data, size_t i,
+                            const wstring& pattern, bool at_begin)
+    -> Phonet_Reference_Match
+{
+	auto ret = Phonet_Reference_Match();
+	auto j = pattern.find_first_of(L"(<-0123456789^$");
+	if (j == pattern.npos)
+		j = pattern.size();
+	if (data.compare(i, j, pattern, 0, j) == 0)
+		ret.count_matched = j;
+	else
+		return {};
+	if (j == pattern.size())
+		return ret;
+	if (pattern[j] == '(') {
+		auto k = pattern.find(')', j);
+		if (k == pattern.npos)
+			return {};
+		auto x = char_traits<wchar_t>::find(&pattern[j + 1],
+		                                    k - (j + 1), data[i + j]);
+		if (!x)
+			return {};
+		j = k + 1;
+		ret.count_matched += 1;
+	}
+	if (j == pattern.size())
+		return ret;
+	if (pattern[j] == '<') {
+		ret.go_back_after_replace = true;
+		++j;
+	}
+	auto k = pattern.find_first_not_of('-', j);
+	if (k == pattern.npos) {
+		k = pattern.size();
+		ret.go_back_before_replace = k - j;
+		if (ret.go_back_before_replace >= ret.count_matched)
+			return {};
+		return ret;
+	}
+	ret.go_back_before_replace = k - j;
+	if (ret.go_back_before_replace >= ret.count_matched)
+		return {};
+	j = k;
+	if (pattern[j] >= '0' && pattern[j] <= '9') {
+		ret.priority = pattern[j] - '0';
+		++j;
+	}
+	if (j == pattern.size())
+		return ret;
+	if (pattern[j] == '^') {
+		if (!at_begin)
+			return {};
+		++j;
+	}
+	if (j == pattern.size())
+		return ret;
+	if (pattern[j] == '^') {
+		ret.treat_next_as_begin = true;
+		++j;
+	}
+	if (j == pattern.size())
+		return ret;
+	if (pattern[j] != '$')
+		return {};
+	if (i + ret.count_matched == data.size())
+		return ret;
+	return {};
+}
+auto phonet_reference(vector<pair<wstring, wstring>> table, wstring word,
+                      bool drop_unmatched) -> wstring
+{
+	stable_sort(begin(table), end(table), [](auto& a, auto& b) {
+		if (b.first.empty())
+			return false;
+		if (a.first.empty())
+			return true;
+		return a.first[0] < b.first[0];
+	});
+	table.erase(begin(table),
+	            find_if_not(begin(table), end(table),
+	                        [](auto& p) { return p.first.empty(); }));
+	for (auto& r : table)
+		if (r.second == L"_")
+			r.second.clear();
+	auto rules_of = [&](wchar_t c) {
+		auto ret = vector<const pair<wstring, wstring>*>();
+		for (auto& r : table)
+			if (r.first[0] == c)
+				ret.push_back(&r);
+		return ret;
+	};
+	auto treat_next_as_begin = true;
+	size_t count_go_backs_after_replace = 0;
+	for (size_t i = 0; i != word.size(); ++i) {
+		auto matched = false;
+		for (auto r : rules_of(word[i])) {
+			auto rule = r;
+			auto m1 = phonet_reference_match(word, i, r->first,
+			                                 treat_next_as_begin);
+			if (!m1.count_matched)
+				continue;
+			if (!m1.go_back_before_replace) {
+				auto j = i + m1.count_matched - 1;
+				for (auto r2 : rules_of(word[j])) {
+					auto m2 = phonet_reference_match(
+					    word, j, r2->first, false);
+					if (m2.count_matched &&
+					    m2.priority >= m1.priority) {
+						i = j;
+						rule = r2;
+						m1 = m2;
+						break;
+					}
+				}
+			}
+			word.replace(
+			    i, m1.count_matched - m1.go_back_before_replace,
+			    rule->second);
+			treat_next_as_begin = m1.treat_next_as_begin;
+			if (m1.go_back_after_replace &&
+			    count_go_backs_after_replace < 100)
+				count_go_backs_after_replace++;
+			else
+				i += rule->second.size();
+			--i;
+			matched = true;
+			break;
+		}
+		if (!matched && drop_unmatched) {
+			word.erase(i, 1);
+			--i;
+		}
+	}
+	return word;
+}
+
+// The english rules of Aspell, used by Hunspell's en_US dictionary too.
+auto english_phonetic_rules() -> vector<pair<wstring, wstring>>
+{
+	return {{L"AH(AEIOUY)-^", L"*H"},
+	        {L"AR(AEIOUY)-^", L"*R"},
+	        {L"A(HR)^", L"*"},
+	        {L"A^", L"*"},
+	        {L"AH(AEIOUY)-", L"H"},
+	        {L"AR(AEIOUY)-", L"R"},
+	        {L"A(HR)", L"_"},
+	        {L"BB-", L"_"},
+	        {L"B", L"B"},
+	        {L"CQ-", L"_"},
+	        {L"CIA", L"X"},
+	        {L"CH", L"X"},
+	        {L"C(EIY)-", L"S"},
+	        {L"CK", L"K"},
+	        {L"COUGH^", L"KF"},
+	        {L"CC<", L"C"},
+	        {L"C", L"K"},
+	        {L"DG(EIY)", L"K"},
+	        {L"DD-", L"_"},
+	        {L"D", L"T"},
+	        {L"É<", L"E"},
+	        {L"EH(AEIOUY)-^", L"*H"},
+	        {L"ER(AEIOUY)-^", L"*R"},
+	        {L"E(HR)^", L"*"},
+	        {L"ENOUGH^$", L"*NF"},
+	        {L"E^", L"*"},
+	        {L"EH(AEIOUY)-", L"H"},
+	        {L"ER(AEIOUY)-", L"R"},
+	        {L"E(HR)", L"_"},
+	        {L"FF-", L"_"},
+	        {L"F", L"F"},
+	        {L"GN^", L"N"},
+	        {L"GN$", L"N"},
+	        {L"GNS$", L"NS"},
+	        {L"GNED$", L"N"},
+	        {L"GH(AEIOUY)-", L"K"},
+	        {L"GH", L"_"},
+	        {L"GG9", L"K"},
+	        {L"G", L"K"},
+	        {L"H", L"H"},
+	        {L"IH(AEIOUY)-^", L"*H"},
+	        {L"IR(AEIOUY)-^", L"*R"},
+	        {L"I(HR)^", L"*"},
+	        {L"I^", L"*"},
+	        {L"ING6", L"N"},
+	        {L"IH(AEIOUY)-", L"H"},
+	        {L"IR(AEIOUY)-", L"R"},
+	        {L"I(HR)", L"_"},
+	        {L"J", L"K"},
+	        {L"KN^", L"N"},
+	        {L"KK-", L"_"},
+	        {L"K", L"K"},
+	        {L"LAUGH^", L"LF"},
+	        {L"LL-", L"_"},
+	        {L"L", L"L"},
+	        {L"MB$", L"M"},
+	        {L"MM", L"M"},
+	        {L"M", L"M"},
+	        {L"NN-", L"_"},
+	        {L"N", L"N"},
+	        {L"OH(AEIOUY)-^", L"*H"},
+	        {L"OR(AEIOUY)-^", L"*R"},
+	        {L"O(HR)^", L"*"},
+	        {L"O^", L"*"},
+	        {L"OH(AEIOUY)-", L"H"},
+	        {L"OR(AEIOUY)-", L"R"},
+	        {L"O(HR)", L"_"},
+	        {L"PH", L"F"},
+	        {L"PN^", L"N"},
+	        {L"PP-", L"_"},
+	        {L"P", L"P"},
+	        {L"Q", L"K"},
+	        {L"RH^", L"R"},
+	        {L"ROUGH^", L"RF"},
+	        {L"RR-", L"_"},
+	        {L"R", L"R"},
+	        {L"SCH(EOU)-", L"SK"},
+	        {L"SC(IEY)-", L"S"},
+	        {L"SH", L"X"},
+	        {L"SI(AO)-", L"X"},
+	        {L"SS-", L"_"},
+	        {L"S", L"S"},
+	        {L"TI(AO)-", L"X"},
+	        {L"TH", L"@"},
+	        {L"TCH--", L"_"},
+	        {L"TOUGH^", L"TF"},
+	        {L"TT-", L"_"},
+	        {L"T", L"T"},
+	        {L"UH(AEIOUY)-^", L"*H"},
+	        {L"UR(AEIOUY)-^", L"*R"},
+	        {L"U(HR)^", L"*"},
+	        {L"U^", L"*"},
+	        {L"UH(AEIOUY)-", L"H"},
+	        {L"UR(AEIOUY)-", L"R"},
+	        {L"U(HR)", L"_"},
+	        {L"V^", L"W"},
+	        {L"V", L"F"},
+	        {L"WR^", L"R"},
+	        {L"WH^", L"W"},
+	        {L"W(AEIOU)-", L"W"},
+	        {L"X^", L"S"},
+	        {L"X", L"KS"},
+	        {L"Y(AEIOU)-", L"Y"},
+	        {L"ZZ-", L"_"},
+	        {L"Z", L"S"}};
+}
+} // namespace
+
+TEST_CASE("Phonetic_Table english rules against reference", "[structures]")
+{
+	auto rules = english_phonetic_rules();
+	auto table = Phonetic_Table<wchar_t>(rules);
+	auto words = {L"BRASILLIAN", L"ENOUGH",  L"COUGH",     L"LAUGHING",
+	              L"KNIGHT",     L"SCHOOL",  L"WHICH",     L"GNOMES",
+	              L"ACCEPT",     L"CAFÉ",    L"DODGE",     L"SIGNED",
+	              L"THOUGHT",    L"ROUGHLY", L"XYLOPHONE", L"PNEUMATIC"};
+	for (auto w : words) {
+		auto word = wstring(w);
+		table.replace(word);
+		CHECK(word == phonet_reference(rules, w, false));
+		word = w;
+		table.code(word);
+		CHECK(word == phonet_reference(rules, w, true));
+	}
+	auto word = wstring(L"BRASILLIAN");
+	table.code(word);
+	CHECK(word == L"BRSLN");
+
+	auto rng = minstd_rand(4321);
+	auto alphabet = wstring(L"ABCDEGHIKLNOPRSTUWYÉ");
+	for (int n = 0; n != 3000; ++n) {
+		auto w = wstring();
+		for (auto len = rng() % 12; len != 0; --len)
+			w += alphabet[rng() % alphabet.size()];
+		auto drop = n % 2 == 0;
+		auto word = w;
+		if (drop)
+			table.code(word);
+		else
+			table.replace(word);
+		CHECK(word == phonet_reference(rules, w, drop));
+	}
+}
+
+TEST_CASE("Phonetic_Table random rules against reference", "[structures]")
+{
+	auto rng = minstd_rand(98765);
+	auto letters = wstring(L"ABCĀ");
+	auto options = wstring(L"<-0123456789^$()");
+	auto rand_str = [&](const wstring& chars, size_t max_len) {
+		auto str = wstring();
+		for (auto len = rng() % (max_len + 1); len != 0; --len)
+			str += chars[rng() % chars.size()];
+		return str;
+	};
+	for (int n = 0; n != 2000; ++n) {
+		auto rules = vector<pair<wstring, wstring>>();
+		for (auto num = rng() % 8; num != 0; --num) {
+			auto pattern = rand_str(letters, 3);
+			if (rng() % 2)
+				pattern += L'(' + rand_str(letters, 2) + L')';
+			pattern += rand_str(options, 3);
+			auto replacement = rng() % 5 ? rand_str(letters, 2)
+			                             : wstring(L"_");
+			rules.emplace_back(pattern, replacement);
+		}
+		auto table = Phonetic_Table<wchar_t>(rules);
+		for (int k = 0; k != 5; ++k) {
+			auto w = rand_str(letters, 10);
+			auto drop = k % 2 == 0;
+			auto word = w;
+			if (drop)
+				table.code(word);
+			else
+				table.replace(word);
+			CHECK(word == phonet_reference(rules, w, drop));
+		}
+	}
 }